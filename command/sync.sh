@@ -13,6 +13,30 @@ regenerateSymbols()
 	done <<< "$files"
 }
 
+# Build index of symbols used to quickly find objects with symbols
+buildSymbolIndex()
+{
+	rm -f "$SYMBOL_INDEX_FILE"
+	./symindex --build -o "$SYMBOL_INDEX_FILE" -s "$SYSTEM_MAP" -k "$MODULES_DIR" || \
+	logWarn "Can't build the index of symbols"
+}
+
+# Save state of sources used to quickly find modified files
+snapshotSources()
+{
+	local args=(-d "$SOURCE_DIR" -m "$SOURCE_MANIFEST_FILE")
+	[[ "$SOURCE_WATCHER" == 1 ]] && args+=(-w "$SOURCE_DIRTY_FILE")
+	rm -f "$SOURCE_MANIFEST_FILE" "$SOURCE_DIRTY_FILE"
+	if [ "$KERN_SRC_INSTALL_DIR" ]; then
+		./srcwatch --snapshot "${args[@]}" -b "$KERN_SRC_INSTALL_DIR"
+	else
+		# only files tracked by git are reported by "git diff"
+		git --work-tree="$SOURCE_DIR" --git-dir="$workdir/.git" -c core.quotePath=off \
+			ls-files -- '*.c' '*.h' | ./srcwatch --snapshot "${args[@]}" -l -
+	fi
+	[[ $? != 0 ]] && rm -f "$SOURCE_MANIFEST_FILE"
+}
+
 main()
 {
 	local run=$1
@@ -24,14 +48,18 @@ main()
 
 	logInfo "Synchronize..."
 	rm -rf "$workdir"/deku_*
+	rm -rf "$PRISTINE_CACHE_DIR"
+	rm -rf "$MODULE_CACHE_DIR"
 	getKernelVersion > "$KERNEL_VERSION_FILE"
 	regenerateSymbols
+	buildSymbolIndex
 
 	if [ "$KERN_SRC_INSTALL_DIR" ]; then
 		touch -r "$KERN_SRC_INSTALL_DIR" "$KERNEL_VERSION_FILE"
 	else
 		git --work-tree="$SOURCE_DIR" --git-dir="$workdir/.git" add "$SOURCE_DIR/*"
 	fi
+	snapshotSources
 }
 
 main $@
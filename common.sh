@@ -58,10 +58,38 @@ generateSymbols()
 }
 export -f generateSymbols
 
+# Find objects with the symbols in the index built at sync. The first array is
+# filled with the object name and the second with the number of symbols with
+# this name in the object. Symbols that can't be found are not added
+findObjsWithSymbols()
+{
+	local -n symobjs=$1
+	local -n symcounts=$2
+	shift 2
+	[[ -f "$SYMBOL_INDEX_FILE" && $# != 0 ]] || return 1
+
+	local out
+	out=$(./symindex --lookup -i "$SYMBOL_INDEX_FILE" -- "$@") || return 1
+	local name obj path type pos count
+	while read -r name obj path type pos count; do
+		[[ "$obj" == "-" ]] && continue
+		symobjs[$name]=$obj
+		symcounts[$name]=$count
+	done <<< "$out"
+	return $NO_ERROR
+}
+export -f findObjsWithSymbols
+
 findObjWithSymbol()
 {
 	local sym=$1
 	local srcfile=$2
+	local -A objs counts
+
+	if findObjsWithSymbols objs counts "$sym" && [[ "${objs[$sym]}" ]]; then
+		echo ${objs[$sym]}
+		return $NO_ERROR
+	fi
 
 	#TODO: For module objects try to find symbol in the same module
 	#TODO: Consider checking type of the symbol
@@ -113,6 +141,12 @@ export -f getKernelReleaseVersion
 # find modified files
 modifiedFiles()
 {
+	if [[ -f "$SOURCE_MANIFEST_FILE" ]]; then
+		local args=(-d "$SOURCE_DIR" -m "$SOURCE_MANIFEST_FILE")
+		[[ -f "$SOURCE_DIRTY_FILE" ]] && args+=(-w "$SOURCE_DIRTY_FILE")
+		./srcwatch --changes "${args[@]}" && return
+	fi
+
 	if [ ! "$KERN_SRC_INSTALL_DIR" ]; then
 		git -C "$workdir" diff --name-only | grep -E ".+\.[ch]$"
 		return
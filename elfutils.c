@@ -14,9 +14,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include <gelf.h>
 
+#ifdef __x86_64__
+#include <nmmintrin.h>
+#endif
+
 #ifdef SUPPORT_DISASS
 #define PACKAGE 1			//requred by libbfd
 #include <dis-asm.h>
@@ -26,6 +33,13 @@
 
 #define ERROR_UNSUPPORTED_READ_MOSTLY 30
 
+#define ELF_CACHE_SIZE 16
+// number of symbols compared by --diff in one task of the worker pool
+#define DIFF_CHUNK_SYMBOLS 512
+#define BATCH_END_MARKER "@end"
+#define BATCH_EXIT_MARKER "@exit"
+#define FINGERPRINT_DB_MAGIC "DEKUFPR1"
+
 static bool ShowDebugLog = 0;
 #define LOG_ERR(fmt, ...)												\
 	do																	\
@@ -70,13 +84,252 @@ typedef struct
 	size_t st_size;
 	size_t st_value;
 	unsigned char st_info;
-	size_t *callees;
 } Symbol;
 
-static Symbol **Symbols = NULL;
+// hash table of names, the same layout as in the ELF .hash section
+typedef struct
+{
+	const char **names;
+	size_t *buckets;
+	size_t *chain;
+	size_t bucketsCount;
+} NameIndex;
+
+// relocations for one section sorted by offset
+typedef struct
+{
+	const Elf64_Rela *relas;
+	size_t count;
+	bool loaded;
+	// false if "relas" points to the section data
+	bool owned;
+} SectionRelocations;
+
+typedef struct
+{
+	Elf *elf;
+	size_t shstrndx;
+	size_t sectionsCount;
+	GElf_Shdr *shdrs;
+	NameIndex sections;
+	// index of the RELA section for each section, 0 if there is none
+	size_t *relaSections;
+	SectionRelocations *relocations;
+	Elf_Scn *symtabScn;
+	Elf_Scn *strtabScn;
+	Elf64_Word symtabLink;
+	Elf_Data *symData;
+	// symbols in the native layout, points to symData for 64-bit ELF files
+	const Elf64_Sym *syms;
+	bool symsOwned;
+	size_t symCount;
+	NameIndex symbols;
+} ElfIndex;
+
+// address range of a sized symbol, used to find the symbol that covers an offset in a section
+typedef struct
+{
+	size_t start;
+	size_t end;
+	// the highest end of this and all preceding ranges in the same section
+	size_t maxEnd;
+	size_t symIndex;
+} SymbolRange;
+
+// edges of the call graph in compressed sparse row form
+typedef struct
+{
+	// edges of symbol "i" are in edges[offsets[i]] ... edges[offsets[i + 1] - 1]
+	size_t *offsets;
+	size_t *edges;
+} CallGraph;
+
+// state of the function in walkCallerChains
+enum
+{
+	CHAIN_UNVISITED,
+	CHAIN_ON_PATH,
+	CHAIN_REACHES,
+	CHAIN_DEAD,
+};
+
+typedef struct
+{
+	const bool *stop;
+	uint8_t *state;
+	// caller through which the function reaches the first stop function
+	size_t *next;
+	// position on the path of the function that is on the path
+	size_t *depth;
+	size_t *path;
+} ChainWalk;
+
+// string table that is built in memory and written to the section at the end
+typedef struct
+{
+	Elf_Scn *scn;
+	char *buf;
+	size_t size;
+	size_t capacity;
+	// open addressing hash table of offsets + 1 of strings in the buffer
+	size_t *slots;
+	size_t slotsCount;
+	size_t stringsCount;
+} StrtabBuilder;
+
+// relocations of one output RELA section
+typedef struct
+{
+	Elf_Scn *scn;
+	GElf_Rela *relas;
+	size_t count;
+	size_t capacity;
+} RelaVector;
+
+/*
+ * Output ELF built by --extract. Symbols and relocations are collected in
+ * memory and written to the sections only in finalizeOutElf.
+ */
+typedef struct
+{
+	Elf *elf;
+	StrtabBuilder shstrtab;
+	StrtabBuilder strtab;
+	Elf_Scn *symtabScn;
+	GElf_Sym *syms;
+	size_t symsCount;
+	size_t symsCapacity;
+	size_t localSymsCount;
+	// indexed by the RELA section index in the input ELF
+	RelaVector *relas;
+	size_t relasCount;
+} ExtractContext;
+
+// header of the fingerprint database written by --fingerprint
+typedef struct
+{
+	char magic[8];
+	// name of the FingerprintEngine used for hashes
+	char engine[16];
+	uint32_t entriesCount;
+	uint32_t stringsSize;
+} FingerprintDbHeader;
+
+// fingerprint of a function or variable, followed in the file by the names
+typedef struct
+{
+	uint64_t hash;
+	uint64_t size;
+	// offset of the name in the strings
+	uint32_t name;
+	// STT_FUNC or STT_OBJECT
+	uint8_t type;
+	// index in FunctionClasses
+	uint8_t funClass;
+	uint8_t traceable;
+	uint8_t reserved;
+} FingerprintEntry;
+
+// fingerprints of all functions and variables of the object, used by --diff in place of the ELF
+typedef struct
+{
+	char *buf;
+	const FingerprintEntry *entries;
+	size_t entriesCount;
+	NameIndex names;
+} FingerprintDb;
+
+// location of the ftrace call site
+typedef struct
+{
+	size_t secIndex;
+	size_t offset;
+} CallSite;
+
+typedef struct
+{
+	CallSite *sites;
+	size_t count;
+	bool found;
+} CallSites;
+
+// pair of objects compared by --diff
+typedef struct
+{
+	const char *firstFile;
+	const char *secondFile;
+	const char *label;
+	Elf *firstElf;
+	// fingerprints loaded instead of the first ELF file
+	FingerprintDb *firstDb;
+	Elf *secondElf;
+	// object of the running kernel, functions missing there are inlined
+	Elf *kernelElf;
+	// image of the kernel, searched for functions with the same name
+	Elf *vmlinuxElf;
+	int firstFd;
+	int secondFd;
+	int kernelFd;
+	// print a record with the details of each symbol instead of the text
+	bool records;
+	// call sites of the second and the first object, found on the first use
+	// by any of the chunks of the pair
+	CallSites callSites[2];
+	pthread_mutex_t callSitesLock;
+} DiffPair;
+
+// range of symbols of one pair compared by one task, output is kept in memory
+typedef struct
+{
+	DiffPair *pair;
+	size_t start;
+	size_t end;
+	char *out;
+	size_t outSize;
+} DiffChunk;
+
+// tasks run on the worker pool, tasks are taken in order by idle workers
+typedef struct
+{
+	void (*run)(void *tasks, size_t index);
+	void *tasks;
+	size_t count;
+	size_t next;
+} WorkQueue;
+
+// ELF file kept open between commands in the batch mode
+typedef struct
+{
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+	size_t lastUse;
+	// number of commands that use the file at the moment
+	size_t refs;
+	Elf *elf;
+} CachedElf;
+
+// symbols of the input ELF, indexed as in .symtab
+static Symbol *Symbols = NULL;
 static Elf_Scn **CopiedScnMap = NULL;
+static ExtractContext Out;
 static size_t SectionsCount = 0;
 static size_t SymbolsCount = 0;
+static ElfIndex **ElfIndexes = NULL;
+static size_t ElfIndexesCount = 0;
+// ranges of Symbols sorted by section index and address
+static SymbolRange *SymbolRanges = NULL;
+// index of the first range of each section in SymbolRanges
+static size_t *SectionRanges = NULL;
+static size_t SectionRangesCount = 0;
+static bool BatchMode = false;
+static CachedElf *ElfCache = NULL;
+static size_t ElfCacheCount = 0;
+static size_t ElfCacheCapacity = 0;
+static size_t ElfCacheClock = 0;
 
 typedef struct
 {
@@ -86,372 +339,916 @@ typedef struct
 	SymbolData *symData;
 } DisasmData;
 
-static uint32_t crc32(uint8_t *data, uint32_t len)
+// hash function used to compare functions between objects
+typedef struct
+{
+	const char *name;
+	uint64_t (*hash)(const uint8_t *data, size_t len);
+} FingerprintEngine;
+
+static uint32_t Crc32Table[8][256];
+static uint32_t Crc32cTable[8][256];
+static bool HasCrc32cInstruction = false;
+static const FingerprintEngine *Fingerprint = NULL;
+
+static void initCrcTable(uint32_t table[8][256], uint32_t poly)
 {
-	uint32_t byte, crc, mask;
-	crc = 0xFFFFFFFF;
-	for (uint32_t i = 0; i < len; i++)
+	for (uint32_t i = 0; i < 256; i++)
 	{
-		byte = data[i];
-		crc = crc ^ byte;
-		for (int j = 7; j >= 0; j--)
-		{
-			mask = -(crc & 1);
-			crc = (crc >> 1) ^ (0xEDB88320 & mask);
-		}
-		i = i + 1;
+		uint32_t crc = i;
+		for (int j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (poly & -(crc & 1));
+		table[0][i] = crc;
+	}
+	for (int k = 1; k < 8; k++)
+	{
+		for (int i = 0; i < 256; i++)
+			table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+	}
+}
+
+static inline uint32_t readLE32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t readLE64(const uint8_t *p)
+{
+	return (uint64_t)readLE32(p) | (uint64_t)readLE32(p + 4) << 32;
+}
+
+// table driven CRC that process 8 bytes per iteration
+static uint32_t crcSlicingBy8(uint32_t table[8][256], const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (; len >= 8; data += 8, len -= 8)
+	{
+		uint32_t lo = readLE32(data) ^ crc;
+		uint32_t hi = readLE32(data + 4);
+		crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+			  table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+			  table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+			  table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
 	}
+	for (; len > 0; data++, len--)
+		crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
 	return ~crc;
 }
 
-static size_t appendString(GElf_Shdr *shdr, Elf_Data *data, const char *text)
+static uint64_t fingerprintCrc32(const uint8_t *data, size_t len)
 {
-	size_t oldSize = data->d_size;
-	size_t newSize = data->d_size + strlen(text) + 1;
-	char *buf = (char *)calloc(1, newSize);
-	CHECK_ALLOC(buf);
+	return crcSlicingBy8(Crc32Table, data, len);
+}
 
-	memcpy(buf, data->d_buf, data->d_size);
-	strcpy(&buf[data->d_size], text);
-	data->d_buf = buf;
-	data->d_size = newSize;
-	shdr->sh_size = newSize;
-	return oldSize;
+static uint64_t fingerprintCrc32cSoft(const uint8_t *data, size_t len)
+{
+	return crcSlicingBy8(Crc32cTable, data, len);
 }
 
-static GElf_Shdr getSectionHeader(Elf *elf, Elf64_Section index)
+#ifdef __x86_64__
+__attribute__((target("sse4.2")))
+static uint64_t fingerprintCrc32cHw(const uint8_t *data, size_t len)
 {
-	GElf_Shdr shdr = {0};
-	size_t shstrndx;
-	elf_getshdrstrndx(elf, &shstrndx);
-	Elf_Scn *scn = elf_getscn(elf, index);
-	if (scn)
-		gelf_getshdr(scn, &shdr);
-	return shdr;
+	uint64_t crc = 0xFFFFFFFF;
+	for (; len >= 8; data += 8, len -= 8)
+		crc = _mm_crc32_u64(crc, readLE64(data));
+	uint32_t crc32 = (uint32_t)crc;
+	for (; len > 0; data++, len--)
+		crc32 = _mm_crc32_u8(crc32, *data);
+	return ~crc32;
 }
+#endif
 
-static Elf_Scn *getSectionByName(Elf *elf, const char *secName)
+static uint64_t fingerprintCrc32c(const uint8_t *data, size_t len)
 {
-	Elf_Scn *scn = NULL;
-	GElf_Shdr shdr;
-	size_t shstrndx;
-	elf_getshdrstrndx(elf, &shstrndx);
-	while ((scn = elf_nextscn(elf, scn)) != NULL)
+#ifdef __x86_64__
+	if (HasCrc32cInstruction)
+		return fingerprintCrc32cHw(data, len);
+#endif
+	return fingerprintCrc32cSoft(data, len);
+}
+
+// MurmurHash64A
+static uint64_t fingerprintHash64(const uint8_t *data, size_t len)
+{
+	const uint64_t m = 0xC6A4A7935BD1E995ULL;
+	const int r = 47;
+	uint64_t h = 0x8445D61A4E774912ULL ^ (len * m);
+	for (; len >= 8; data += 8, len -= 8)
 	{
-		gelf_getshdr(scn, &shdr);
-		char *name = elf_strptr(elf, shstrndx, shdr.sh_name);
-		if (name != NULL && strcmp(name, secName) == 0)
-			return scn;
+		uint64_t k = readLE64(data);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
 	}
-	return NULL;
+	if (len > 0)
+	{
+		uint64_t k = 0;
+		for (size_t i = 0; i < len; i++)
+			k |= (uint64_t)data[i] << (8 * i);
+		h ^= k;
+		h *= m;
+	}
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
 }
 
-static Elf_Scn *getRelForSectionIndex(Elf *elf, Elf64_Section index)
+static const FingerprintEngine FingerprintEngines[] =
 {
-	Elf_Scn *scn = NULL;
-	GElf_Shdr shdr;
-	while ((scn = elf_nextscn(elf, scn)) != NULL)
+	{ "crc32", fingerprintCrc32 },
+	{ "crc32c", fingerprintCrc32c },
+	{ "crc32c-soft", fingerprintCrc32cSoft },
+	{ "hash64", fingerprintHash64 },
+};
+
+static void initFingerprint(void)
+{
+	initCrcTable(Crc32Table, 0xEDB88320);
+	initCrcTable(Crc32cTable, 0x82F63B78);
+#ifdef __x86_64__
+	__builtin_cpu_init();
+	HasCrc32cInstruction = __builtin_cpu_supports("sse4.2");
+#endif
+	Fingerprint = &FingerprintEngines[1];
+}
+
+static const FingerprintEngine *getFingerprintEngine(const char *name)
+{
+	for (size_t i = 0; i < sizeof(FingerprintEngines) / sizeof(*FingerprintEngines); i++)
 	{
-		gelf_getshdr(scn, &shdr);
-		if (shdr.sh_type == SHT_RELA && shdr.sh_info == index)
-			return scn;
+		if (strcmp(FingerprintEngines[i].name, name) == 0)
+			return &FingerprintEngines[i];
 	}
 	return NULL;
 }
 
-static char *getSectionName(Elf *elf, Elf64_Section index)
+static uint32_t nameHash(const char *name)
 {
-	size_t shstrndx;
-	elf_getshdrstrndx(elf, &shstrndx);
-	GElf_Shdr shdr = getSectionHeader(elf, index);
-	return elf_strptr(elf, shstrndx, shdr.sh_name);
+	uint32_t h = 5381;
+	for (const uint8_t *c = (const uint8_t *)name; *c != '\0'; c++)
+		h = (h << 5) + h + *c;
+	return h;
 }
 
-static Symbol **readSymbols(Elf *elf)
+static void strtabInsertSlot(StrtabBuilder *strtab, size_t offset)
 {
-	Symbol **syms;
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
-	GElf_Shdr shdr;
-	GElf_Sym sym;
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	syms = (Symbol **)calloc(cnt + 1, sizeof(Symbol *));
-	CHECK_ALLOC(syms);
-	for (size_t i = 0; i < cnt; i++)
+	size_t i = nameHash(strtab->buf + offset) & (strtab->slotsCount - 1);
+	while (strtab->slots[i] != 0)
+		i = (i + 1) & (strtab->slotsCount - 1);
+	strtab->slots[i] = offset + 1;
+	strtab->stringsCount++;
+}
+
+static size_t strtabFind(const StrtabBuilder *strtab, const char *text)
+{
+	if (strtab->slotsCount == 0)
+		return 0;
+	size_t i = nameHash(text) & (strtab->slotsCount - 1);
+	for (; strtab->slots[i] != 0; i = (i + 1) & (strtab->slotsCount - 1))
 	{
-		gelf_getsym(data, i, &sym);
-		syms[i] = calloc(1, sizeof(Symbol));
-		CHECK_ALLOC(syms[i]);
-		// name
-		syms[i]->name = elf_strptr(elf, shdr.sh_link, sym.st_name);
-		// section index
-		syms[i]->secIndex = sym.st_shndx;
-		// is function
-		if ((sym.st_info == ELF64_ST_INFO(STB_GLOBAL, STT_FUNC) ||
-			 (sym.st_info == ELF64_ST_INFO(STB_LOCAL, STT_FUNC))) &&
-			strlen(syms[i]->name) > 0)
-		{
-			syms[i]->isFun = true;
-		}
-		// is variable
-		if (sym.st_info == ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT) ||
-			(sym.st_info == ELF64_ST_INFO(STB_LOCAL, STT_OBJECT)))
+		if (strcmp(strtab->buf + strtab->slots[i] - 1, text) == 0)
+			return strtab->slots[i];
+	}
+	return 0;
+}
+
+static void strtabIndex(StrtabBuilder *strtab, size_t offset)
+{
+	if ((strtab->stringsCount + 1) * 2 > strtab->slotsCount)
+	{
+		size_t *oldSlots = strtab->slots;
+		size_t oldCount = strtab->slotsCount;
+		strtab->slotsCount = oldCount ? oldCount * 2 : 64;
+		strtab->slots = calloc(strtab->slotsCount, sizeof(size_t));
+		CHECK_ALLOC(strtab->slots);
+		strtab->stringsCount = 0;
+		for (size_t i = 0; i < oldCount; i++)
 		{
-			const char *scnName = getSectionName(elf, sym.st_shndx);
-			if (strstr(scnName, ".data.") == scnName ||
-				strstr(scnName, ".bss.") == scnName)
-				syms[i]->isVar = true;
-			if (strstr(scnName, ".rodata.") == scnName ||
-				strstr(scnName, ".rodata.str") != scnName)
-				syms[i]->isVar = true;
+			if (oldSlots[i] != 0)
+				strtabInsertSlot(strtab, oldSlots[i] - 1);
 		}
-		syms[i]->st_info = sym.st_info;
-		syms[i]->st_size = sym.st_size;
-		syms[i]->st_value = sym.st_value;
-		syms[i]->index = SymbolsCount++;
+		free(oldSlots);
 	}
+	strtabInsertSlot(strtab, offset);
+}
 
-	return syms;
+static void strtabInit(StrtabBuilder *strtab, Elf_Scn *scn)
+{
+	memset(strtab, 0, sizeof(*strtab));
+	strtab->scn = scn;
+	strtab->capacity = 4096;
+	strtab->buf = calloc(1, strtab->capacity);
+	CHECK_ALLOC(strtab->buf);
+	strtab->size = 1;
 }
 
-static GElf_Sym getSymbolByName(Elf *elf, char *name, size_t *symIndex)
+/*
+ * Add string to the table and return its offset. The same string added again
+ * gets the same offset.
+ */
+static Elf64_Word strtabAdd(StrtabBuilder *strtab, const char *text)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	GElf_Shdr shdr;
-	GElf_Sym sym = {0};
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	*symIndex = 0;
-	for (size_t i = 0; i < cnt; i++)
+	if (text[0] == '\0')
+		return 0;
+
+	size_t found = strtabFind(strtab, text);
+	if (found != 0)
+		return found - 1;
+
+	size_t len = strlen(text) + 1;
+	if (strtab->size + len > strtab->capacity)
 	{
-		gelf_getsym(data, i, &sym);
-		if (strcmp(elf_strptr(elf, shdr.sh_link, sym.st_name), name) == 0)
-			return sym;
-		(*symIndex)++;
+		while (strtab->size + len > strtab->capacity)
+			strtab->capacity *= 2;
+		strtab->buf = realloc(strtab->buf, strtab->capacity);
+		CHECK_ALLOC(strtab->buf);
 	}
-	memset(&sym, 0, sizeof(sym));
-	*symIndex = 0;
-	return sym;
+	size_t offset = strtab->size;
+	memcpy(strtab->buf + offset, text, len);
+	strtab->size += len;
+
+	strtabIndex(strtab, offset);
+	return offset;
 }
 
-static bool getSymbolByNameAndType(Elf *elf, const char *symName, const int type, GElf_Sym *sym)
+// Write the table to its section. Must be called before elf_update.
+static void strtabFinalize(StrtabBuilder *strtab)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
 	GElf_Shdr shdr;
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
-	{
-		gelf_getsym(data, i, sym);
-		if ((sym->st_info == ELF64_ST_INFO(STB_LOCAL, type) ||
-			 sym->st_info == ELF64_ST_INFO(STB_GLOBAL, type)) &&
-			strcmp(elf_strptr(elf, shdr.sh_link, sym->st_name), symName) == 0)
-			return true;
-	}
-	return false;
+	Elf_Data *data = elf_getdata(strtab->scn, NULL);
+	data->d_buf = strtab->buf;
+	data->d_size = strtab->size;
+	gelf_getshdr(strtab->scn, &shdr);
+	shdr.sh_size = strtab->size;
+	gelf_update_shdr(strtab->scn, &shdr);
 }
 
-static GElf_Sym getSymbolByIndex(Elf *elf, size_t index)
+static void strtabFree(StrtabBuilder *strtab)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	GElf_Shdr shdr;
-	GElf_Sym sym = {0};
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	if (index < cnt)
-		gelf_getsym(data, index, &sym);
-	return sym;
+	free(strtab->buf);
+	free(strtab->slots);
+	memset(strtab, 0, sizeof(*strtab));
 }
 
-static uint16_t getSymbolIndexByName(Elf *elf, const char *symName)
+/*
+ * Build hash table for the names. The "names" array is owned by the index.
+ * Entry at index 0 and entries with empty name are not added to the table.
+ */
+static void buildNameIndex(NameIndex *index, const char **names, size_t count)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
-	GElf_Sym sym;
-	GElf_Shdr shdr;
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	index->names = names;
+	index->bucketsCount = count / 2 + 1;
+	index->buckets = calloc(index->bucketsCount, sizeof(size_t));
+	CHECK_ALLOC(index->buckets);
+	index->chain = calloc(count + 1, sizeof(size_t));
+	CHECK_ALLOC(index->chain);
+	// insert in reverse order to keep the lowest index at the head of the chain
+	for (size_t i = count; i-- > 1;)
+	{
+		if (names[i] == NULL || names[i][0] == '\0')
+			continue;
+		size_t bucket = nameHash(names[i]) % index->bucketsCount;
+		index->chain[i] = index->buckets[bucket];
+		index->buckets[bucket] = i;
+	}
+}
+
+/*
+ * Find the next entry with the given name. Entries are returned in the
+ * order of the names array. Pass 0 as "prev" to get the first entry.
+ * Returns 0 if there are no more entries with this name.
+ */
+static size_t findInNameIndex(const NameIndex *index, const char *name, size_t prev)
+{
+	size_t i;
+	if (prev == 0)
+		i = index->buckets[nameHash(name) % index->bucketsCount];
+	else
+		i = index->chain[prev];
+	for (; i != 0; i = index->chain[i])
 	{
-		gelf_getsym(data, i, &sym);
-		if (strcmp(elf_strptr(elf, shdr.sh_link, sym.st_name), symName) == 0)
+		if (strcmp(index->names[i], name) == 0)
 			return i;
 	}
 	return 0;
 }
 
-static Symbol *getSymbolForRelocation(const GElf_Rela rela)
+static void freeNameIndex(NameIndex *index)
 {
-	size_t symIndex = ELF64_R_SYM(rela.r_info);
-	if (Symbols[symIndex]->secIndex == 0)
-		return Symbols[symIndex];
-	if (Symbols[symIndex]->st_size > 0)
-		return Symbols[symIndex];
-	if (ELF64_ST_TYPE(Symbols[symIndex]->st_info) == STT_FUNC ||
-		ELF64_ST_TYPE(Symbols[symIndex]->st_info) == STT_OBJECT)
-		return Symbols[symIndex];
-
-	size_t secIndex = Symbols[symIndex]->secIndex;
-	Elf64_Sxword addend = rela.r_addend;
-	switch (ELF64_R_TYPE(rela.r_info))
+	free(index->names);
+	free(index->buckets);
+	free(index->chain);
+}
+
+static ElfIndex *buildElfIndex(Elf *elf)
+{
+	ElfIndex *index = calloc(1, sizeof(ElfIndex));
+	CHECK_ALLOC(index);
+	index->elf = elf;
+	if (elf_getshdrstrndx(elf, &index->shstrndx))
+		LOG_ERR("Cannot get section header string index");
+	elf_getshdrnum(elf, &index->sectionsCount);
+
+	// sections
+	const char **secNames = calloc(index->sectionsCount + 1, sizeof(char *));
+	CHECK_ALLOC(secNames);
+	index->shdrs = calloc(index->sectionsCount + 1, sizeof(GElf_Shdr));
+	CHECK_ALLOC(index->shdrs);
+	Elf_Scn *scn = NULL;
+	while ((scn = elf_nextscn(elf, scn)) != NULL)
 	{
-	case R_386_PC32:
-	case R_X86_64_PLT32:
-		addend += 4;
-		break;
+		size_t i = elf_ndxscn(scn);
+		gelf_getshdr(scn, &index->shdrs[i]);
+		secNames[i] = elf_strptr(elf, index->shstrndx, index->shdrs[i].sh_name);
 	}
+	for (size_t i = 0; i < index->sectionsCount; i++)
+	{
+		if (secNames[i] == NULL)
+			secNames[i] = "";
+	}
+	buildNameIndex(&index->sections, secNames, index->sectionsCount);
 
-	for (Symbol **s = Symbols; *s != NULL; s++)
+	index->relaSections = calloc(index->sectionsCount + 1, sizeof(size_t));
+	CHECK_ALLOC(index->relaSections);
+	index->relocations = calloc(index->sectionsCount + 1, sizeof(SectionRelocations));
+	CHECK_ALLOC(index->relocations);
+	for (size_t i = 0; i < index->sectionsCount; i++)
 	{
-		if (s[0]->index != symIndex && s[0]->secIndex == secIndex &&
-			(size_t)addend >= s[0]->st_value &&
-			(size_t)addend < s[0]->st_value + s[0]->st_size)
-			return s[0];
+		GElf_Shdr *shdr = &index->shdrs[i];
+		if (shdr->sh_type == SHT_RELA && shdr->sh_info < index->sectionsCount &&
+			index->relaSections[shdr->sh_info] == 0)
+			index->relaSections[shdr->sh_info] = i;
 	}
 
-	// example: referer to symbol (st_value == st_size == 0) that points to .rodata.str1.1
-	return Symbols[symIndex];
+	size_t symtabIndex = findInNameIndex(&index->sections, ".symtab", 0);
+	size_t strtabIndex = findInNameIndex(&index->sections, ".strtab", 0);
+	if (strtabIndex == 0)
+		LOG_ERR("Failed to find .strtab section");
+	if (symtabIndex == 0)
+		LOG_ERR("Failed to find .symtab section");
+	index->symtabScn = elf_getscn(elf, symtabIndex);
+	index->strtabScn = elf_getscn(elf, strtabIndex);
+
+	// symbols
+	GElf_Shdr *shdr = &index->shdrs[symtabIndex];
+	index->symtabLink = shdr->sh_link;
+	index->symData = elf_getdata(index->symtabScn, NULL);
+	index->symCount = shdr->sh_size / shdr->sh_entsize;
+	if (gelf_getclass(elf) == ELFCLASS64)
+	{
+		index->syms = index->symData->d_buf;
+	}
+	else
+	{
+		Elf64_Sym *syms = calloc(index->symCount + 1, sizeof(Elf64_Sym));
+		CHECK_ALLOC(syms);
+		for (size_t i = 0; i < index->symCount; i++)
+			gelf_getsym(index->symData, i, &syms[i]);
+		index->syms = syms;
+		index->symsOwned = true;
+	}
+	const char **symNames = calloc(index->symCount + 1, sizeof(char *));
+	CHECK_ALLOC(symNames);
+	for (size_t i = 0; i < index->symCount; i++)
+	{
+		const Elf64_Sym *sym = &index->syms[i];
+		symNames[i] = sym->st_name ? elf_strptr(elf, shdr->sh_link, sym->st_name) : "";
+		if (symNames[i] == NULL)
+			symNames[i] = "";
+	}
+	buildNameIndex(&index->symbols, symNames, index->symCount);
+
+	return index;
 }
 
-static GElf_Sym getLinkedSym(Elf *elf, GElf_Sym *sym)
+static ElfIndex *getElfIndex(Elf *elf)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	GElf_Shdr shdr;
-	GElf_Sym tsym = {0};
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	for (size_t i = 0; i < ElfIndexesCount; i++)
 	{
-		gelf_getsym(data, i, &tsym);
-		if (memcmp(&tsym, sym, sizeof(*sym)) != 0 && tsym.st_name != 0 &&
-				   tsym.st_shndx == sym->st_shndx)
-			return tsym;
+		if (ElfIndexes[i]->elf == elf)
+			return ElfIndexes[i];
 	}
-	memset(&tsym, 0, sizeof(tsym));
-	return tsym;
+	ElfIndexes = realloc(ElfIndexes, (ElfIndexesCount + 1) * sizeof(ElfIndex *));
+	CHECK_ALLOC(ElfIndexes);
+	ElfIndexes[ElfIndexesCount] = buildElfIndex(elf);
+	return ElfIndexes[ElfIndexesCount++];
 }
 
-static SymbolData getSymbolData(Elf *elf, const char *name, char type, bool modReloc)
+static void freeElfIndex(Elf *elf)
 {
-	SymbolData result;
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
-	GElf_Shdr shdr;
-	GElf_Sym sym;
-	size_t secCount;
-	elf_getshdrnum(elf, &secCount);
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	for (size_t i = 0; i < ElfIndexesCount; i++)
 	{
-		gelf_getsym(data, i, &sym);
-		if (strcmp(elf_strptr(elf, shdr.sh_link, sym.st_name), name) == 0)
+		if (ElfIndexes[i]->elf != elf)
+			continue;
+		freeNameIndex(&ElfIndexes[i]->sections);
+		freeNameIndex(&ElfIndexes[i]->symbols);
+		for (size_t j = 0; j < ElfIndexes[i]->sectionsCount; j++)
 		{
-			if (ELF64_ST_TYPE(sym.st_info) == type &&
-				sym.st_size > 0 && sym.st_shndx < secCount)
-			{
-				Elf_Scn *scn = elf_getscn(elf, sym.st_shndx);
-				Elf_Data *data = elf_getdata(scn, NULL);
-				result.data = &((uint8_t *)data->d_buf)[sym.st_value];
-				result.size = sym.st_size;
-				if (modReloc)
-				{
-					GElf_Rela rela;
-					GElf_Shdr shdr;
-					Elf_Scn *scn = getRelForSectionIndex(elf, sym.st_shndx);
-					if (scn == NULL)
-						continue;
-					Elf_Data *rdata = elf_getdata(scn, NULL);
-					gelf_getshdr(scn, &shdr);
-					size_t cnt = shdr.sh_size / shdr.sh_entsize;
-					for (size_t i = 0; i < cnt; i++)
-					{
-						gelf_getrela(rdata, i, &rela);
-						if (rela.r_offset >= sym.st_value && rela.r_offset < sym.st_value + sym.st_size)
-						{
-							void *addr = &((uint8_t *)data->d_buf)[rela.r_offset];
-							if (ELF64_R_TYPE(rela.r_info) == R_X86_64_PC32)
-								*(uint32_t *)addr += -4;
-							else
-								*(uint32_t *)addr += rela.r_addend;
-						}
-					}
-				}
-				break;
-			}
+			if (ElfIndexes[i]->relocations[j].owned)
+				free((Elf64_Rela *)ElfIndexes[i]->relocations[j].relas);
 		}
+		if (ElfIndexes[i]->symsOwned)
+			free((Elf64_Sym *)ElfIndexes[i]->syms);
+		free(ElfIndexes[i]->relocations);
+		free(ElfIndexes[i]->relaSections);
+		free(ElfIndexes[i]->shdrs);
+		free(ElfIndexes[i]);
+		ElfIndexes[i] = ElfIndexes[--ElfIndexesCount];
+		return;
 	}
-	return result;
 }
 
-#ifdef SUPPORT_DISASSEMBLE
-
-static GElf_Sym getSymbolForReloc(Elf *elf, Elf64_Section sec, size_t offset)
+static GElf_Shdr getSectionHeader(Elf *elf, Elf64_Section index)
 {
-	GElf_Rela rela;
-	GElf_Shdr shdr;
-	GElf_Sym invalidSym = {};
-	Elf_Scn *scn = getRelForSectionIndex(elf, sec);
-	if(scn == NULL)
-		return invalidSym;
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	ElfIndex *elfIndex = getElfIndex(elf);
+	if (index >= elfIndex->sectionsCount)
 	{
-		gelf_getrela(data, i, &rela);
-		if (rela.r_offset == offset)
-			return getSymbolByIndex(elf, ELF64_R_SYM(rela.r_info));
+		GElf_Shdr shdr = {0};
+		return shdr;
 	}
-	return invalidSym;
+	return elfIndex->shdrs[index];
 }
 
-static GElf_Sym getSymbolByOffset(Elf *elf, Elf64_Section shndx, size_t offset)
+static Elf_Scn *getSectionByName(Elf *elf, const char *secName)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	GElf_Shdr shdr;
-	GElf_Sym sym = {};
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
-	{
-		gelf_getsym(data, i, &sym);
-		if (sym.st_name != 0 && sym.st_shndx == shndx && sym.st_value == offset)
-			return sym;
-	}
-	memset(&sym, 0, sizeof(sym));
-	return sym;
+	size_t index = findInNameIndex(&getElfIndex(elf)->sections, secName, 0);
+	if (index == 0)
+		return NULL;
+	return elf_getscn(elf, index);
 }
 
-static int disasmPrintf(void *buf, const char *format, ...)
+static Elf_Scn *getRelForSectionIndex(Elf *elf, Elf64_Section index)
 {
-	char localBuf[MAX_DISASS_LINE_LEN];
-	va_list args;
-	va_start (args, format);
-	int len = vsnprintf(localBuf, sizeof(localBuf), format, args);
-	va_end (args);
-
-	char **buffer = (char **)buf;
-	buffer[0] = realloc(buffer[0], strlen(buffer[0]) + len + 1);
-	strcat(buffer[0], localBuf);
-	return len;
+	ElfIndex *elfIndex = getElfIndex(elf);
+	if (index >= elfIndex->sectionsCount || elfIndex->relaSections[index] == 0)
+		return NULL;
+	return elf_getscn(elf, elfIndex->relaSections[index]);
 }
 
-static void printFunAtAddr(bfd_vma vma, struct disassemble_info *inf)
+typedef struct
+{
+	GElf_Rela rela;
+	size_t pos;
+} RelaEntry;
+
+static int compareRelaEntries(const void *a, const void *b)
+{
+	const RelaEntry *ra = a;
+	const RelaEntry *rb = b;
+	if (ra->rela.r_offset != rb->rela.r_offset)
+		return ra->rela.r_offset < rb->rela.r_offset ? -1 : 1;
+	if (ra->pos != rb->pos)
+		return ra->pos < rb->pos ? -1 : 1;
+	return 0;
+}
+
+static void loadRelocations(SectionRelocations *relocs, Elf *elf, Elf_Scn *relScn)
+{
+	GElf_Shdr shdr;
+	Elf_Data *data = elf_getdata(relScn, NULL);
+	gelf_getshdr(relScn, &shdr);
+	size_t cnt = shdr.sh_entsize ? shdr.sh_size / shdr.sh_entsize : 0;
+	relocs->count = cnt;
+
+	// relocations of 64-bit ELF files are used in place unless they have to be sorted
+	if (gelf_getclass(elf) == ELFCLASS64 && cnt > 0 && shdr.sh_entsize == sizeof(Elf64_Rela))
+	{
+		const Elf64_Rela *view = data->d_buf;
+		bool sorted = true;
+		for (size_t i = 1; i < cnt && sorted; i++)
+			sorted = view[i].r_offset >= view[i - 1].r_offset;
+		if (sorted)
+		{
+			relocs->relas = view;
+			return;
+		}
+	}
+
+	Elf64_Rela *relas = calloc(cnt + 1, sizeof(Elf64_Rela));
+	CHECK_ALLOC(relas);
+	relocs->relas = relas;
+	relocs->owned = true;
+
+	bool sorted = true;
+	for (size_t i = 0; i < cnt; i++)
+	{
+		gelf_getrela(data, i, &relas[i]);
+		if (i > 0 && relas[i].r_offset < relas[i - 1].r_offset)
+			sorted = false;
+	}
+	if (sorted)
+		return;
+
+	// keep the file order of relocations with the same offset
+	RelaEntry *entries = calloc(cnt, sizeof(RelaEntry));
+	CHECK_ALLOC(entries);
+	for (size_t i = 0; i < cnt; i++)
+	{
+		entries[i].rela = relas[i];
+		entries[i].pos = i;
+	}
+	qsort(entries, cnt, sizeof(RelaEntry), compareRelaEntries);
+	for (size_t i = 0; i < cnt; i++)
+		relas[i] = entries[i].rela;
+	free(entries);
+}
+
+/*
+ * Get all relocations for the section sorted by offset. Relocations are read
+ * on the first use and cached until the ELF is closed.
+ */
+static const GElf_Rela *getRelocations(Elf *elf, Elf64_Section index, size_t *count)
+{
+	ElfIndex *elfIndex = getElfIndex(elf);
+	*count = 0;
+	if (index >= elfIndex->sectionsCount || elfIndex->relaSections[index] == 0)
+		return NULL;
+
+	SectionRelocations *relocs = &elfIndex->relocations[index];
+	if (!relocs->loaded)
+	{
+		loadRelocations(relocs, elf, elf_getscn(elf, elfIndex->relaSections[index]));
+		relocs->loaded = true;
+	}
+	*count = relocs->count;
+	return relocs->relas;
+}
+
+static size_t findFirstRelocation(const GElf_Rela *relas, size_t count, size_t offset)
+{
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (relas[mid].r_offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Get relocations for the section with offsets in range [start, end)
+static const GElf_Rela *getRelocationsInRange(Elf *elf, Elf64_Section index, size_t start,
+										size_t end, size_t *count)
+{
+	size_t cnt;
+	const GElf_Rela *relas = getRelocations(elf, index, &cnt);
+	*count = 0;
+	if (relas == NULL || start >= end)
+		return NULL;
+
+	size_t first = findFirstRelocation(relas, cnt, start);
+	size_t last = findFirstRelocation(relas, cnt, end);
+	*count = last - first;
+	return &relas[first];
+}
+
+static const char *getSectionName(Elf *elf, Elf64_Section index)
+{
+	ElfIndex *elfIndex = getElfIndex(elf);
+	if (index >= elfIndex->sectionsCount)
+		return "";
+	return elfIndex->sections.names[index];
+}
+
+static size_t findSymbolByName(Elf *elf, const char *name, size_t prev)
+{
+	return findInNameIndex(&getElfIndex(elf)->symbols, name, prev);
+}
+
+static int compareSymbolRanges(const void *a, const void *b)
+{
+	const SymbolRange *ra = a;
+	const SymbolRange *rb = b;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	if (ra->symIndex != rb->symIndex)
+		return ra->symIndex < rb->symIndex ? -1 : 1;
+	return 0;
+}
+
+static void freeSymbolRanges(void)
+{
+	free(SymbolRanges);
+	free(SectionRanges);
+	SymbolRanges = NULL;
+	SectionRanges = NULL;
+	SectionRangesCount = 0;
+}
+
+static void buildSymbolRanges(Symbol *syms, size_t count, size_t sectionsCount)
+{
+	freeSymbolRanges();
+	SectionRanges = calloc(sectionsCount + 1, sizeof(size_t));
+	CHECK_ALLOC(SectionRanges);
+	SectionRangesCount = sectionsCount;
+
+	// count ranges per section and turn counts into the start positions
+	size_t rangesCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (syms[i].st_size > 0 && syms[i].secIndex < sectionsCount)
+		{
+			SectionRanges[syms[i].secIndex + 1]++;
+			rangesCount++;
+		}
+	}
+	for (size_t i = 0; i < sectionsCount; i++)
+		SectionRanges[i + 1] += SectionRanges[i];
+
+	SymbolRanges = calloc(rangesCount + 1, sizeof(SymbolRange));
+	CHECK_ALLOC(SymbolRanges);
+	size_t *next = malloc((sectionsCount + 1) * sizeof(size_t));
+	CHECK_ALLOC(next);
+	memcpy(next, SectionRanges, (sectionsCount + 1) * sizeof(size_t));
+	for (size_t i = 0; i < count; i++)
+	{
+		if (syms[i].st_size == 0 || syms[i].secIndex >= sectionsCount)
+			continue;
+
+		SymbolRange *range = &SymbolRanges[next[syms[i].secIndex]++];
+		range->start = syms[i].st_value;
+		range->end = syms[i].st_value + syms[i].st_size;
+		range->symIndex = i;
+	}
+	free(next);
+
+	for (size_t sec = 0; sec < sectionsCount; sec++)
+	{
+		SymbolRange *ranges = &SymbolRanges[SectionRanges[sec]];
+		size_t rangesInSec = SectionRanges[sec + 1] - SectionRanges[sec];
+		qsort(ranges, rangesInSec, sizeof(SymbolRange), compareSymbolRanges);
+		size_t maxEnd = 0;
+		for (size_t i = 0; i < rangesInSec; i++)
+		{
+			if (ranges[i].end > maxEnd)
+				maxEnd = ranges[i].end;
+			ranges[i].maxEnd = maxEnd;
+		}
+	}
+}
+
+/*
+ * Find the symbol whose range covers the offset in the section. When more
+ * symbols overlap the offset, the one with the lowest index wins.
+ */
+static Symbol *findSymbolByAddress(size_t secIndex, size_t offset)
+{
+	if (secIndex >= SectionRangesCount)
+		return NULL;
+
+	SymbolRange *ranges = &SymbolRanges[SectionRanges[secIndex]];
+	size_t lo = 0;
+	size_t hi = SectionRanges[secIndex + 1] - SectionRanges[secIndex];
+	// find the first range that starts after the offset
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (ranges[mid].start <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	SymbolRange *result = NULL;
+	for (size_t i = lo; i-- > 0 && ranges[i].maxEnd > offset;)
+	{
+		if (offset < ranges[i].end &&
+			(result == NULL || ranges[i].symIndex < result->symIndex))
+			result = &ranges[i];
+	}
+	return result != NULL ? &Symbols[result->symIndex] : NULL;
+}
+
+// Check if objects in the section are variables
+static bool isVarSection(Elf *elf, Elf64_Section index)
+{
+	const char *scnName = getSectionName(elf, index);
+	if (strstr(scnName, ".data.") == scnName ||
+		strstr(scnName, ".bss.") == scnName)
+		return true;
+	if (strstr(scnName, ".rodata.") == scnName ||
+		strstr(scnName, ".rodata.str") != scnName)
+		return true;
+	return false;
+}
+
+// Read all symbols into the "Symbols" array. Release them with freeSymbols.
+static void readSymbols(Elf *elf)
+{
+	ElfIndex *index = getElfIndex(elf);
+	size_t cnt = index->symCount;
+	Symbols = calloc(cnt + 1, sizeof(Symbol));
+	CHECK_ALLOC(Symbols);
+	SymbolsCount = cnt;
+
+	// the class of the section is shared by all objects inside it
+	bool *varSections = calloc(index->sectionsCount + 1, sizeof(bool));
+	CHECK_ALLOC(varSections);
+	for (size_t i = 0; i < index->sectionsCount; i++)
+		varSections[i] = isVarSection(elf, i);
+
+	for (size_t i = 0; i < cnt; i++)
+	{
+		Symbol *s = &Symbols[i];
+		const Elf64_Sym *sym = &index->syms[i];
+		s->name = (char *)index->symbols.names[i];
+		s->secIndex = sym->st_shndx;
+		s->isFun = (sym->st_info == ELF64_ST_INFO(STB_GLOBAL, STT_FUNC) ||
+					sym->st_info == ELF64_ST_INFO(STB_LOCAL, STT_FUNC)) &&
+				   s->name[0] != '\0';
+		if (sym->st_info == ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT) ||
+			sym->st_info == ELF64_ST_INFO(STB_LOCAL, STT_OBJECT))
+		{
+			s->isVar = sym->st_shndx < index->sectionsCount ?
+					   varSections[sym->st_shndx] : isVarSection(elf, sym->st_shndx);
+		}
+		s->st_info = sym->st_info;
+		s->st_size = sym->st_size;
+		s->st_value = sym->st_value;
+		s->index = i;
+	}
+	free(varSections);
+
+	buildSymbolRanges(Symbols, cnt, index->sectionsCount);
+}
+
+static void freeSymbols(void)
+{
+	free(Symbols);
+	Symbols = NULL;
+	SymbolsCount = 0;
+	freeSymbolRanges();
+}
+
+static GElf_Sym getSymbolByName(Elf *elf, char *name, size_t *symIndex)
+{
+	GElf_Sym sym = {0};
+	*symIndex = findSymbolByName(elf, name, 0);
+	if (*symIndex != 0)
+		sym = getElfIndex(elf)->syms[*symIndex];
+	return sym;
+}
+
+static bool getSymbolByNameAndType(Elf *elf, const char *symName, const int type, GElf_Sym *sym)
+{
+	const Elf64_Sym *syms = getElfIndex(elf)->syms;
+	for (size_t i = findSymbolByName(elf, symName, 0); i != 0;
+		 i = findSymbolByName(elf, symName, i))
+	{
+		*sym = syms[i];
+		if (sym->st_info == ELF64_ST_INFO(STB_LOCAL, type) ||
+			sym->st_info == ELF64_ST_INFO(STB_GLOBAL, type))
+			return true;
+	}
+	return false;
+}
+
+static GElf_Sym getSymbolByIndex(Elf *elf, size_t index)
+{
+	ElfIndex *elfIndex = getElfIndex(elf);
+	GElf_Sym sym = {0};
+	if (index < elfIndex->symCount)
+		sym = elfIndex->syms[index];
+	return sym;
+}
+
+static size_t getSymbolIndexByName(Elf *elf, const char *symName)
+{
+	return findSymbolByName(elf, symName, 0);
+}
+
+static Symbol *getSymbolForRelocation(const GElf_Rela rela)
+{
+	size_t symIndex = ELF64_R_SYM(rela.r_info);
+	if (Symbols[symIndex].secIndex == 0)
+		return &Symbols[symIndex];
+	if (Symbols[symIndex].st_size > 0)
+		return &Symbols[symIndex];
+	if (ELF64_ST_TYPE(Symbols[symIndex].st_info) == STT_FUNC ||
+		ELF64_ST_TYPE(Symbols[symIndex].st_info) == STT_OBJECT)
+		return &Symbols[symIndex];
+
+	size_t secIndex = Symbols[symIndex].secIndex;
+	Elf64_Sxword addend = rela.r_addend;
+	switch (ELF64_R_TYPE(rela.r_info))
+	{
+	case R_386_PC32:
+	case R_X86_64_PLT32:
+		addend += 4;
+		break;
+	}
+
+	Symbol *sym = findSymbolByAddress(secIndex, (size_t)addend);
+	if (sym != NULL)
+		return sym;
+
+	// example: referer to symbol (st_value == st_size == 0) that points to .rodata.str1.1
+	return &Symbols[symIndex];
+}
+
+static GElf_Sym getLinkedSym(Elf *elf, GElf_Sym *sym)
+{
+	ElfIndex *index = getElfIndex(elf);
+	GElf_Sym tsym = {0};
+	size_t cnt = index->symCount;
+	for (size_t i = 0; i < cnt; i++)
+	{
+		const Elf64_Sym *s = &index->syms[i];
+		if (memcmp(s, sym, sizeof(*sym)) != 0 && s->st_name != 0 &&
+				   s->st_shndx == sym->st_shndx)
+			return *s;
+	}
+	return tsym;
+}
+
+static SymbolData getSymbolData(Elf *elf, const char *name, char type, bool modReloc)
+{
+	SymbolData result = {0};
+	GElf_Sym sym;
+	size_t secCount;
+	elf_getshdrnum(elf, &secCount);
+	const Elf64_Sym *syms = getElfIndex(elf)->syms;
+	for (size_t i = findSymbolByName(elf, name, 0); i != 0;
+		 i = findSymbolByName(elf, name, i))
+	{
+		sym = syms[i];
+		if (ELF64_ST_TYPE(sym.st_info) == type &&
+			sym.st_size > 0 && sym.st_shndx < secCount)
+		{
+			Elf_Scn *scn = elf_getscn(elf, sym.st_shndx);
+			Elf_Data *data = elf_getdata(scn, NULL);
+			result.data = &((uint8_t *)data->d_buf)[sym.st_value];
+			result.size = sym.st_size;
+			if (modReloc)
+			{
+				size_t cnt;
+				const GElf_Rela *relas = getRelocationsInRange(elf, sym.st_shndx, sym.st_value,
+														 sym.st_value + sym.st_size, &cnt);
+				if (relas == NULL)
+					continue;
+				for (size_t i = 0; i < cnt; i++)
+				{
+					void *addr = &((uint8_t *)data->d_buf)[relas[i].r_offset];
+					if (ELF64_R_TYPE(relas[i].r_info) == R_X86_64_PC32)
+						*(uint32_t *)addr += -4;
+					else
+						*(uint32_t *)addr += relas[i].r_addend;
+				}
+			}
+			break;
+		}
+	}
+	return result;
+}
+
+#ifdef SUPPORT_DISASSEMBLE
+
+static GElf_Sym getSymbolForReloc(Elf *elf, Elf64_Section sec, size_t offset)
+{
+	GElf_Sym invalidSym = {};
+	size_t cnt;
+	const GElf_Rela *relas = getRelocationsInRange(elf, sec, offset, offset + 1, &cnt);
+	if (cnt == 0)
+		return invalidSym;
+	return getSymbolByIndex(elf, ELF64_R_SYM(relas[0].r_info));
+}
+
+static GElf_Sym getSymbolByOffset(Elf *elf, Elf64_Section shndx, size_t offset)
+{
+	ElfIndex *index = getElfIndex(elf);
+	GElf_Sym sym = {};
+	size_t cnt = index->symCount;
+	for (size_t i = 0; i < cnt; i++)
+	{
+		const Elf64_Sym *s = &index->syms[i];
+		if (s->st_name != 0 && s->st_shndx == shndx && s->st_value == offset)
+			return *s;
+	}
+	return sym;
+}
+
+static int disasmPrintf(void *buf, const char *format, ...)
+{
+	char localBuf[MAX_DISASS_LINE_LEN];
+	va_list args;
+	va_start (args, format);
+	int len = vsnprintf(localBuf, sizeof(localBuf), format, args);
+	va_end (args);
+
+	char **buffer = (char **)buf;
+	buffer[0] = realloc(buffer[0], strlen(buffer[0]) + len + 1);
+	strcat(buffer[0], localBuf);
+	return len;
+}
+
+static void printFunAtAddr(bfd_vma vma, struct disassemble_info *inf)
 {
 	DisasmData *data = (DisasmData *)inf->application_data;
 	int32_t x = *(uint32_t *)(data->symData->data + vma);
@@ -503,126 +1300,466 @@ char *disassembleBytes(uint8_t *inputBuf, size_t inputBufSize, DisasmData *data)
 }
 #endif
 
-static uint32_t calcSymHash(Elf *elf, const GElf_Sym *sym)
+// Hash of names of symbols that are referenced by relocations in the symbol
+static uint64_t calcRelocationsHash(Elf *elf, const GElf_Sym *sym)
 {
-	Elf_Scn *scn = elf_getscn(elf, sym->st_shndx);
-	Elf_Data *data = elf_rawdata(scn, NULL);
-	uint32_t crc = crc32((uint8_t *)data->d_buf + sym->st_value, sym->st_size);
-
-	GElf_Rela rela;
-	GElf_Shdr shdr;
-	scn = getRelForSectionIndex(elf, sym->st_shndx);
-	if (scn == NULL)
-		return crc;
-	Elf_Data *rdata = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-
-	scn = getSectionByName(elf, ".symtab");
-	gelf_getshdr(scn, &shdr);
-	Elf64_Word symtabLink = shdr.sh_link;
+	uint64_t hash = 0;
+	size_t cnt;
+	const GElf_Rela *relas = getRelocationsInRange(elf, sym->st_shndx, sym->st_value,
+											 sym->st_value + sym->st_size, &cnt);
+	Elf64_Word symtabLink = getElfIndex(elf)->symtabLink;
 
 	for (size_t i = 0; i < cnt; i++)
 	{
-		gelf_getrela(rdata, i, &rela);
-		if (rela.r_offset >= sym->st_value && rela.r_offset < sym->st_value + sym->st_size)
+		GElf_Rela rela = relas[i];
+		GElf_Sym rsym = getSymbolByIndex(elf, ELF64_R_SYM(rela.r_info));
+		if(invalidSym(rsym))
+			LOG_ERR("Can't find symbol at index: %ld", ELF64_R_SYM(rela.r_info));
+		int secIndex = rsym.st_shndx;
+		const char *name = NULL;
+		if(rsym.st_name == 0)
 		{
-			GElf_Sym rsym = getSymbolByIndex(elf, ELF64_R_SYM(rela.r_info));
-			if(invalidSym(rsym))
-				LOG_ERR("Can't find symbol at index: %ld", ELF64_R_SYM(rela.r_info));
-			int secIndex = rsym.st_shndx;
-			const char *name = NULL;
-			if(rsym.st_name == 0)
+			if (rsym.st_info == STT_SECTION)
 			{
-				if (rsym.st_info == STT_SECTION)
-				{
-					name = getSectionName(elf, secIndex);
-				}
-				else
-				{
-					rsym = getLinkedSym(elf, &rsym);
-					if(invalidSym(rsym))
-						LOG_ERR("Can't find symbol at index: %ld", ELF64_R_SYM(rela.r_info));
-					name = elf_strptr(elf, symtabLink, rsym.st_name);
-				}
+				name = getSectionName(elf, secIndex);
 			}
 			else
 			{
+				rsym = getLinkedSym(elf, &rsym);
+				if(invalidSym(rsym))
+					LOG_ERR("Can't find symbol at index: %ld", ELF64_R_SYM(rela.r_info));
 				name = elf_strptr(elf, symtabLink, rsym.st_name);
 			}
-			if (name)
+		}
+		else
+		{
+			name = elf_strptr(elf, symtabLink, rsym.st_name);
+		}
+		if (name)
+		{
+			if (strstr(name, ".str.") || strstr(name, ".str1.") || strstr(name, ".rodata.str") == name)
 			{
-				if (strstr(name, ".str.") || strstr(name, ".str1.") || strstr(name, ".rodata.str") == name)
-				{
-					Elf_Scn *scn = elf_getscn(elf, secIndex);
-					Elf_Data *data = elf_getdata(scn, NULL);
-					GElf_Shdr shdr;
-					gelf_getshdr(scn, &shdr);
-					if ((Elf64_Sxword)shdr.sh_size > rela.r_addend)
-						name = (char *)data->d_buf + rela.r_addend;
-				}
-				if (strstr(name, ".text.unlikely.") == name)
-					name += strlen(".text.unlikely.");
-				else if (strstr(name, ".text.") == name)
-					name += strlen(".text.");
-				crc += crc32((uint8_t *)name, strlen(name));
+				Elf_Data *data = elf_getdata(elf_getscn(elf, secIndex), NULL);
+				GElf_Shdr shdr = getSectionHeader(elf, secIndex);
+				if ((Elf64_Sxword)shdr.sh_size > rela.r_addend)
+					name = (char *)data->d_buf + rela.r_addend;
 			}
+			if (strstr(name, ".text.unlikely.") == name)
+				name += strlen(".text.unlikely.");
+			else if (strstr(name, ".text.") == name)
+				name += strlen(".text.");
+			hash += Fingerprint->hash((const uint8_t *)name, strlen(name));
 		}
 	}
-	return crc;
+	return hash;
 }
 
-static bool equalFunctions(Elf *elf, Elf *secondElf, const char *funName)
+static uint64_t calcSymHash(Elf *elf, const GElf_Sym *sym)
 {
-	SymbolData symData1 = getSymbolData(elf, funName, STT_FUNC, false);
-	SymbolData symData2 = getSymbolData(secondElf, funName, STT_FUNC, false);
+	Elf_Scn *scn = elf_getscn(elf, sym->st_shndx);
+	Elf_Data *data = elf_rawdata(scn, NULL);
+	uint64_t hash = Fingerprint->hash((uint8_t *)data->d_buf + sym->st_value, sym->st_size);
+	return hash + calcRelocationsHash(elf, sym);
+}
 
-	if (symData1.size != symData2.size)
-		return false;
+static int compareCallSites(const void *a, const void *b)
+{
+	const CallSite *x = a;
+	const CallSite *y = b;
+	if (x->secIndex != y->secIndex)
+		return x->secIndex < y->secIndex ? -1 : 1;
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
 
-	GElf_Sym sym1;
-	GElf_Sym sym2;
-	getSymbolByNameAndType(elf, funName, STT_FUNC, &sym1);
-	getSymbolByNameAndType(secondElf, funName, STT_FUNC, &sym2);
-	return calcSymHash(elf, &sym1) == calcSymHash(secondElf, &sym2);
+static bool isFtraceCall(const char *name)
+{
+	return strcmp(name, "__fentry__") == 0 || strcmp(name, "mcount") == 0 ||
+		   strcmp(name, "_mcount") == 0 || strcmp(name, "__mcount") == 0;
 }
 
-static void findModifiedSymbols(Elf *elf, Elf *secondElf)
+/*
+ * Collect ftrace call sites listed in sections built by the compiler or
+ * recordmcount: __mcount_loc and __patchable_function_entries
+ */
+static CallSite *findRecordedCallSites(Elf *elf, size_t *count)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
-	GElf_Shdr shdr;
-	GElf_Sym sym;
-	size_t secCount;
-	elf_getshdrnum(elf, &secCount);
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	const char *sections[] = { "__mcount_loc", "__patchable_function_entries" };
+	ElfIndex *index = getElfIndex(elf);
+	CallSite *sites = NULL;
+	*count = 0;
+	for (size_t i = 0; i < sizeof(sections) / sizeof(*sections); i++)
 	{
-		gelf_getsym(data, i, &sym);
-		if (sym.st_size == 0 || sym.st_shndx == 0 || sym.st_shndx >= secCount || sym.st_name == 0)
-			continue;
-		const char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
-		if (ELF64_ST_TYPE(sym.st_info) == STT_FUNC)
+		for (size_t sec = findInNameIndex(&index->sections, sections[i], 0); sec != 0;
+			 sec = findInNameIndex(&index->sections, sections[i], sec))
 		{
-			GElf_Sym secondSym;
-			if (!getSymbolByNameAndType(secondElf, name, STT_FUNC, &secondSym))
-			{
-				printf("New function: %s\n", name);
-			}
-			else
+			size_t relasCount;
+			const GElf_Rela *relas = getRelocations(elf, sec, &relasCount);
+			sites = realloc(sites, (*count + relasCount + 1) * sizeof(CallSite));
+			CHECK_ALLOC(sites);
+			for (size_t j = 0; j < relasCount; j++)
 			{
-				if (!equalFunctions(elf, secondElf, name))
-					printf("Modified function: %s\n", name);
+				GElf_Sym sym = getSymbolByIndex(elf, ELF64_R_SYM(relas[j].r_info));
+				sites[*count].secIndex = sym.st_shndx;
+				sites[*count].offset = sym.st_value + relas[j].r_addend;
+				(*count)++;
 			}
 		}
-		else if (ELF64_ST_TYPE(sym.st_info) == STT_OBJECT)
-		{
-			GElf_Sym secondSym;
-			if (!getSymbolByNameAndType(secondElf, name, STT_OBJECT, &secondSym))
-			{
+	}
+	qsort(sites, *count, sizeof(CallSite), compareCallSites);
+	return sites;
+}
+
+static bool hasRecordedCallSite(const CallSite *sites, size_t count, size_t secIndex,
+								size_t start, size_t end)
+{
+	CallSite key = { .secIndex = secIndex, .offset = start };
+	size_t lo = 0;
+	size_t hi = count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (compareCallSites(&sites[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < count && sites[lo].secIndex == secIndex && sites[lo].offset < end;
+}
+
+// check if the ftrace call site exists in the function
+static bool isTraceableSymbol(Elf *elf, const GElf_Sym *sym, const CallSite *sites, size_t sitesCount)
+{
+	size_t start = sym->st_value;
+	size_t end = start + (sym->st_size ? sym->st_size : 1);
+	if (hasRecordedCallSite(sites, sitesCount, sym->st_shndx, start, end))
+		return true;
+
+	size_t relasCount;
+	const GElf_Rela *relas = getRelocationsInRange(elf, sym->st_shndx, start, end, &relasCount);
+	for (size_t i = 0; i < relasCount; i++)
+	{
+		size_t symIndex = ELF64_R_SYM(relas[i].r_info);
+		if (symIndex < getElfIndex(elf)->symCount &&
+			isFtraceCall(getElfIndex(elf)->symbols.names[symIndex]))
+			return true;
+	}
+	return false;
+}
+
+static bool equalFunctions(Elf *elf, Elf *secondElf, const char *funName)
+{
+	SymbolData symData1 = getSymbolData(elf, funName, STT_FUNC, false);
+	SymbolData symData2 = getSymbolData(secondElf, funName, STT_FUNC, false);
+
+	if (symData1.size != symData2.size)
+		return false;
+
+	// bodies are different so there is no need to look at the relocations
+	if (symData1.size > 0 && memcmp(symData1.data, symData2.data, symData1.size) != 0)
+		return false;
+
+	GElf_Sym sym1;
+	GElf_Sym sym2;
+	getSymbolByNameAndType(elf, funName, STT_FUNC, &sym1);
+	getSymbolByNameAndType(secondElf, funName, STT_FUNC, &sym2);
+	return calcRelocationsHash(elf, &sym1) == calcRelocationsHash(secondElf, &sym2);
+}
+
+static const char *FunctionClasses[] = { "text", "init", "exit", "unlikely" };
+
+// class of the function by its section, index in FunctionClasses
+static uint8_t sectionClass(const char *secName)
+{
+	if (strncmp(secName, ".init.text", strlen(".init.text")) == 0)
+		return 1;
+	if (strncmp(secName, ".exit.text", strlen(".exit.text")) == 0)
+		return 2;
+	if (strncmp(secName, ".text.unlikely", strlen(".text.unlikely")) == 0)
+		return 3;
+	return 0;
+}
+
+// class of the function by its name and section
+static const char *functionClass(Elf *elf, const GElf_Sym *sym, const char *name)
+{
+	if (strstr(name, ".cold") != NULL)
+		return "cold";
+	return FunctionClasses[sectionClass(getSectionName(elf, sym->st_shndx))];
+}
+
+// check if the relocation refers to the symbol directly or by the section symbol
+static bool isRelocationToSymbol(Elf *elf, const GElf_Rela *rela, size_t symIndex,
+								 const GElf_Sym *sym)
+{
+	size_t relSymIndex = ELF64_R_SYM(rela->r_info);
+	if (relSymIndex == symIndex)
+		return true;
+	GElf_Sym relSym = getSymbolByIndex(elf, relSymIndex);
+	if (ELF64_ST_TYPE(relSym.st_info) != STT_SECTION || relSym.st_shndx != sym->st_shndx)
+		return false;
+
+	Elf64_Sxword addend = rela->r_addend;
+	switch (ELF64_R_TYPE(rela->r_info))
+	{
+	case R_386_PC32:
+	case R_X86_64_PLT32:
+		addend += 4;
+		break;
+	}
+	return addend >= (Elf64_Sxword)sym->st_value &&
+		   addend < (Elf64_Sxword)(sym->st_value + sym->st_size);
+}
+
+// print comma separated list of functions that refer to the function
+static void printCallers(Elf *elf, size_t funIndex, FILE *out)
+{
+	ElfIndex *index = getElfIndex(elf);
+	GElf_Sym fun = getSymbolByIndex(elf, funIndex);
+	GElf_Sym sym;
+	size_t printed = 0;
+	for (size_t i = 1; i < index->symCount; i++)
+	{
+		sym = index->syms[i];
+		if (i == funIndex || ELF64_ST_TYPE(sym.st_info) != STT_FUNC ||
+			sym.st_shndx == SHN_UNDEF || sym.st_shndx >= index->sectionsCount)
+			continue;
+
+		size_t cnt;
+		const GElf_Rela *relas = getRelocationsInRange(elf, sym.st_shndx, sym.st_value,
+												 sym.st_value + sym.st_size, &cnt);
+		for (size_t j = 0; j < cnt; j++)
+		{
+			if (isRelocationToSymbol(elf, &relas[j], funIndex, &fun))
+			{
+				fprintf(out, "%s%s", printed++ ? "," : "", index->symbols.names[i]);
+				break;
+			}
+		}
+	}
+	if (printed == 0)
+		fputs("-", out);
+}
+
+// check if the function uses static keys, the same check as in checkStaticKeys
+static bool usesStaticKeys(Elf *elf, const GElf_Sym *fun)
+{
+	ElfIndex *index = getElfIndex(elf);
+	size_t secIndex = findInNameIndex(&index->sections, "__jump_table", 0);
+	if (secIndex == 0)
+		return false;
+
+	size_t cnt;
+	const GElf_Rela *relas = getRelocations(elf, secIndex, &cnt);
+	for (size_t i = 0; i + 2 < cnt; i += 3)
+	{
+		GElf_Sym sym = getSymbolByIndex(elf, ELF64_R_SYM(relas[i].r_info));
+		size_t offset = sym.st_value + relas[i].r_addend;
+		if (sym.st_shndx == fun->st_shndx && offset >= fun->st_value &&
+			offset < fun->st_value + fun->st_size)
+			return true;
+	}
+	return false;
+}
+
+static bool isFingerprintDb(const char *filePath)
+{
+	char magic[sizeof(FINGERPRINT_DB_MAGIC) - 1];
+	FILE *f = fopen(filePath, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
+	bool result = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+				  memcmp(magic, FINGERPRINT_DB_MAGIC, sizeof(magic)) == 0;
+	fclose(f);
+	return result;
+}
+
+static FingerprintDb *loadFingerprintDb(const char *filePath)
+{
+	FILE *f = fopen(filePath, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	FingerprintDb *db = calloc(1, sizeof(FingerprintDb));
+	CHECK_ALLOC(db);
+	db->buf = malloc(size + 1);
+	CHECK_ALLOC(db->buf);
+	if (fread(db->buf, 1, size, f) != (size_t)size)
+		error(EXIT_FAILURE, errno, "Cannot read file '%s'", filePath);
+	fclose(f);
+
+	const FingerprintDbHeader *header = (FingerprintDbHeader *)db->buf;
+	if ((size_t)size < sizeof(*header))
+		LOG_ERR("Invalid fingerprint database: %s", filePath);
+	size_t entriesSize = (size_t)header->entriesCount * sizeof(FingerprintEntry);
+	if ((size_t)size != sizeof(*header) + entriesSize + header->stringsSize)
+		LOG_ERR("Invalid fingerprint database: %s", filePath);
+	if (strncmp(header->engine, Fingerprint->name, sizeof(header->engine)) != 0)
+		LOG_ERR("Fingerprint database '%s' was made with %.*s, but %s is used", filePath,
+				(int)sizeof(header->engine), header->engine, Fingerprint->name);
+
+	db->entries = (FingerprintEntry *)(db->buf + sizeof(*header));
+	db->entriesCount = header->entriesCount;
+	char *strings = db->buf + sizeof(*header) + entriesSize;
+	// names can't go past the end of the buffer
+	strings[header->stringsSize] = '\0';
+	// entry at index 0 is not added to the index
+	const char **names = calloc(db->entriesCount + 1, sizeof(char *));
+	CHECK_ALLOC(names);
+	for (size_t i = 0; i < db->entriesCount; i++)
+	{
+		if (db->entries[i].name >= header->stringsSize)
+			LOG_ERR("Invalid fingerprint database: %s", filePath);
+		names[i + 1] = strings + db->entries[i].name;
+	}
+	buildNameIndex(&db->names, names, db->entriesCount + 1);
+	return db;
+}
+
+static void freeFingerprintDb(FingerprintDb *db)
+{
+	freeNameIndex(&db->names);
+	free(db->buf);
+	free(db);
+}
+
+static const FingerprintEntry *findFingerprint(const FingerprintDb *db, const char *name, uint8_t type)
+{
+	for (size_t i = findInNameIndex(&db->names, name, 0); i != 0;
+		 i = findInNameIndex(&db->names, name, i))
+	{
+		if (db->entries[i - 1].type == type)
+			return &db->entries[i - 1];
+	}
+	return NULL;
+}
+
+// Count symbols with given name defined in the object
+static size_t countDefinedSymbols(Elf *elf, const char *name)
+{
+	const Elf64_Sym *syms = getElfIndex(elf)->syms;
+	size_t count = 0;
+	for (size_t i = findSymbolByName(elf, name, 0); i != 0; i = findSymbolByName(elf, name, i))
+	{
+		if (syms[i].st_shndx != SHN_UNDEF &&
+			ELF64_ST_TYPE(syms[i].st_info) != STT_SECTION &&
+			ELF64_ST_TYPE(syms[i].st_info) != STT_FILE)
+			count++;
+	}
+	return count;
+}
+
+/*
+ * Print the record of the function:
+ * <KIND>\t<NAME>\t<CLASS>\t<CALLERS>\t<STATIC_KEYS>\t<TRACE>\t<INLINED>\t<VMLINUX_COUNT>
+ * KIND - "modified" or "new"
+ * CLASS - init, exit, unlikely, cold or text, taken from the origin object if
+ * the function exists there
+ * CALLERS - functions that refer to the ".cold" part, "-" for other functions
+ * STATIC_KEYS - 1 if the function is referenced from __jump_table
+ * TRACE - "traceable" or "notrace", taken from the origin object if the
+ * function exists there
+ * INLINED - 1 if the function is missing in the object of the running kernel
+ * VMLINUX_COUNT - number of symbols with the same name in the kernel image
+ */
+static void printFunctionRecord(DiffPair *pair, size_t symIndex, const char *kind, FILE *out)
+{
+	Elf *elf = pair->secondElf;
+	Elf *secondElf = pair->firstElf;
+	const FingerprintDb *db = pair->firstDb;
+	const char *name = getElfIndex(elf)->symbols.names[symIndex];
+	GElf_Sym sym = getSymbolByIndex(elf, symIndex);
+	const FingerprintEntry *origin = db ? findFingerprint(db, name, STT_FUNC) : NULL;
+	const char *funClass;
+	bool traceable;
+	if (origin != NULL)
+	{
+		funClass = strstr(name, ".cold") != NULL ? "cold" : FunctionClasses[origin->funClass];
+		traceable = origin->traceable;
+	}
+	else
+	{
+		GElf_Sym originSym;
+		bool inOrigin = secondElf != NULL &&
+						getSymbolByNameAndType(secondElf, name, STT_FUNC, &originSym);
+		Elf *classElf = inOrigin ? secondElf : elf;
+		const GElf_Sym *classSym = inOrigin ? &originSym : &sym;
+		CallSites *sites = &pair->callSites[inOrigin];
+		pthread_mutex_lock(&pair->callSitesLock);
+		if (!sites->found)
+		{
+			sites->sites = findRecordedCallSites(classElf, &sites->count);
+			sites->found = true;
+		}
+		pthread_mutex_unlock(&pair->callSitesLock);
+		funClass = functionClass(classElf, classSym, name);
+		traceable = isTraceableSymbol(classElf, classSym, sites->sites, sites->count);
+	}
+
+	fprintf(out, "%s\t%s\t%s\t", kind, name, funClass);
+	if (strstr(name, ".cold") != NULL)
+		printCallers(elf, symIndex, out);
+	else
+		fputs("-", out);
+	fprintf(out, "\t%d\t%s", usesStaticKeys(elf, &sym), traceable ? "traceable" : "notrace");
+	GElf_Sym kernelSym;
+	bool inlined = pair->kernelElf != NULL &&
+				   !getSymbolByNameAndType(pair->kernelElf, name, STT_FUNC, &kernelSym);
+	size_t count = pair->vmlinuxElf != NULL ? countDefinedSymbols(pair->vmlinuxElf, name) : 0;
+	fprintf(out, "\t%d\t%zu\n", inlined, count);
+}
+
+/*
+ * Print functions and variables of the second object of the pair that are new
+ * or modified compared to the first object or to its fingerprints
+ */
+static void findModifiedSymbols(DiffPair *pair, size_t start, size_t end, FILE *out)
+{
+	Elf *elf = pair->secondElf;
+	Elf *secondElf = pair->firstElf;
+	const FingerprintDb *db = pair->firstDb;
+	bool records = pair->records;
+	ElfIndex *index = getElfIndex(elf);
+	GElf_Sym sym;
+	size_t secCount = index->sectionsCount;
+	for (size_t i = start; i < end && i < index->symCount; i++)
+	{
+		sym = index->syms[i];
+		if (sym.st_size == 0 || sym.st_shndx == 0 || sym.st_shndx >= secCount || sym.st_name == 0)
+			continue;
+		const char *name = index->symbols.names[i];
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FUNC)
+		{
+			bool isNew;
+			bool modified;
+			if (db != NULL)
+			{
+				const FingerprintEntry *origin = findFingerprint(db, name, STT_FUNC);
+				isNew = origin == NULL;
+				modified = !isNew && (origin->size != sym.st_size ||
+									  origin->hash != calcSymHash(elf, &sym));
+			}
+			else
+			{
+				GElf_Sym secondSym;
+				isNew = !getSymbolByNameAndType(secondElf, name, STT_FUNC, &secondSym);
+				modified = !isNew && !equalFunctions(elf, secondElf, name);
+			}
+			if (records && (isNew || modified))
+				printFunctionRecord(pair, i, isNew ? "new" : "modified", out);
+			else if (isNew)
+				fprintf(out, "New function: %s\n", name);
+			else if (modified)
+				fprintf(out, "Modified function: %s\n", name);
+		}
+		else if (ELF64_ST_TYPE(sym.st_info) == STT_OBJECT)
+		{
+			GElf_Sym secondSym;
+			bool isNew = db != NULL ? findFingerprint(db, name, STT_OBJECT) == NULL :
+						 !getSymbolByNameAndType(secondElf, name, STT_OBJECT, &secondSym);
+			if (isNew)
+			{
 				char *bssName = malloc(strlen(name) + 6);
 				CHECK_ALLOC(bssName);
 				char *dataName = malloc(strlen(name) + 7);
@@ -633,7 +1770,12 @@ static void findModifiedSymbols(Elf *elf, Elf *secondElf)
 					strcmp(scnName, bssName) == 0 ||
 					strcmp(scnName, ".data") == 0 ||
 					strcmp(scnName, ".bss") == 0)
-					printf("New variable: %s\n", name);
+				{
+					if (records)
+						fprintf(out, "variable\t%s\t-\t-\t0\t-\t0\t0\n", name);
+					else
+						fprintf(out, "New variable: %s\n", name);
+				}
 
 				free(dataName);
 				free(bssName);
@@ -665,71 +1807,106 @@ static Elf *createNewElf(const char *outFile)
 	m_ehdr->e_shstrndx = 1;
 
 	GElf_Shdr shdr;
-	Elf_Scn *strtabScn = elf_newscn(elf);
-	Elf_Data *newData = elf_newdata(strtabScn);
-	gelf_getshdr(strtabScn, &shdr);
-	static uint8_t blank[1] = {'\0'};
-	newData->d_buf = blank;
-	newData->d_size = 1;
-	Elf64_Word shname = appendString(&shdr, newData, ".strtab");
-	Elf64_Word symtabname = appendString(&shdr, newData, ".symtab");
-	shdr.sh_type = SHT_STRTAB;
-	shdr.sh_name = appendString(&shdr, newData, ".shstrtab");
-	gelf_update_shdr(strtabScn, &shdr);
-
 	Elf_Scn *shstrtabScn = elf_newscn(elf);
-	newData = elf_newdata(shstrtabScn);
-	newData->d_buf = blank;
-	newData->d_size = 1;
+	Elf_Data *newData = elf_newdata(shstrtabScn);
+	newData->d_type = ELF_T_BYTE;
+	strtabInit(&Out.shstrtab, shstrtabScn);
+	Elf64_Word strtabname = strtabAdd(&Out.shstrtab, ".strtab");
+	Elf64_Word symtabname = strtabAdd(&Out.shstrtab, ".symtab");
 	gelf_getshdr(shstrtabScn, &shdr);
-	shdr.sh_size = 1;
 	shdr.sh_type = SHT_STRTAB;
-	shdr.sh_name = shname;
+	shdr.sh_name = strtabAdd(&Out.shstrtab, ".shstrtab");
 	gelf_update_shdr(shstrtabScn, &shdr);
 
+	Elf_Scn *strtabScn = elf_newscn(elf);
+	newData = elf_newdata(strtabScn);
+	newData->d_type = ELF_T_BYTE;
+	strtabInit(&Out.strtab, strtabScn);
+	gelf_getshdr(strtabScn, &shdr);
+	shdr.sh_type = SHT_STRTAB;
+	shdr.sh_name = strtabname;
+	gelf_update_shdr(strtabScn, &shdr);
+
 	Elf_Scn *symtabScn = elf_newscn(elf);
 	newData = elf_newdata(symtabScn);
-	gelf_getshdr(symtabScn, &shdr);
-
-	GElf_Sym emptySym = {0};
 	newData->d_type = ELF_T_SYM;
-	newData->d_buf = malloc(sizeof(GElf_Sym));
-	CHECK_ALLOC(newData->d_buf);
-	memcpy(newData->d_buf, &emptySym, sizeof(GElf_Sym));
-	newData->d_size = sizeof(GElf_Sym);
-
-	shdr.sh_size = sizeof(GElf_Sym);
-	shdr.sh_link = elf_ndxscn(getSectionByName(elf, ".strtab"));
+	gelf_getshdr(symtabScn, &shdr);
+	shdr.sh_link = elf_ndxscn(strtabScn);
 	shdr.sh_type = SHT_SYMTAB;
 	shdr.sh_name = symtabname;
 	shdr.sh_entsize = sizeof(GElf_Sym);
 	gelf_update_shdr(symtabScn, &shdr);
 
+	// every input symbol is copied at most once, plus the null symbol
+	Out.elf = elf;
+	Out.symtabScn = symtabScn;
+	Out.symsCapacity = SymbolsCount + 1;
+	Out.syms = calloc(Out.symsCapacity, sizeof(GElf_Sym));
+	CHECK_ALLOC(Out.syms);
+	Out.symsCount = 1;
+	Out.relasCount = SectionsCount;
+	Out.relas = calloc(Out.relasCount + 1, sizeof(RelaVector));
+	CHECK_ALLOC(Out.relas);
 	return elf;
 }
 
+// Write collected symbols, relocations and strings to the output sections
+static void finalizeOutElf(void)
+{
+	GElf_Shdr shdr;
+	Elf_Data *data = elf_getdata(Out.symtabScn, NULL);
+	data->d_buf = Out.syms;
+	data->d_size = Out.symsCount * sizeof(GElf_Sym);
+	gelf_getshdr(Out.symtabScn, &shdr);
+	shdr.sh_size = data->d_size;
+	shdr.sh_info = Out.localSymsCount;
+	gelf_update_shdr(Out.symtabScn, &shdr);
+
+	for (size_t i = 0; i < Out.relasCount; i++)
+	{
+		RelaVector *vec = &Out.relas[i];
+		if (vec->scn == NULL)
+			continue;
+		data = elf_getdata(vec->scn, NULL);
+		data->d_buf = vec->relas;
+		data->d_size = vec->count * sizeof(GElf_Rela);
+		gelf_getshdr(vec->scn, &shdr);
+		shdr.sh_size = data->d_size;
+		if (!gelf_update_shdr(vec->scn, &shdr))
+			LOG_ERR("gelf_update_shdr failed");
+	}
+
+	strtabFinalize(&Out.shstrtab);
+	strtabFinalize(&Out.strtab);
+	if (elf_update(Out.elf, ELF_C_WRITE) == -1)
+		LOG_ERR("elf_update failed: %s", elf_errmsg(-1));
+	elf_end(Out.elf);
+
+	strtabFree(&Out.shstrtab);
+	strtabFree(&Out.strtab);
+	for (size_t i = 0; i < Out.relasCount; i++)
+		free(Out.relas[i].relas);
+	free(Out.relas);
+	free(Out.syms);
+	memset(&Out, 0, sizeof(Out));
+}
+
 void checkStaticKeys(Elf *elf, bool *symToCopy)
 {
 	Elf_Scn *scn = getSectionByName(elf, "__jump_table");
 	if (scn == NULL)
 		return;
-	Elf_Scn *relScn = getRelForSectionIndex(elf, elf_ndxscn(scn));
-	if (relScn == NULL)
+	size_t cnt;
+	const GElf_Rela *relas = getRelocations(elf, elf_ndxscn(scn), &cnt);
+	if (relas == NULL)
 		LOG_ERR("Can't find relocation section for __jump_table");
 
-	GElf_Rela rela;
-	GElf_Shdr shdr;
-	Elf_Data *data = elf_getdata(relScn, NULL);
-	gelf_getshdr(relScn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i+=3)
+	for (size_t i = 0; i + 2 < cnt; i+=3)
 	{
-		gelf_getrela(data, i, &rela);
-		Symbol *symbol = getSymbolForRelocation(rela);
+		Symbol *symbol = getSymbolForRelocation(relas[i]);
 		if (symToCopy[symbol->index])
 		{
-			gelf_getrela(data, i + 2, &rela);
-			const char *keyName = Symbols[ELF64_R_SYM(rela.r_info)]->name;
+			const char *keyName = Symbols[ELF64_R_SYM(relas[i + 2].r_info)].name;
 			LOG_INFO("The '%s' function uses static key `%s` that is not yet "
 					 "supported by DEKU.", symbol->name, keyName);
 		}
@@ -744,675 +1921,2133 @@ static Elf_Scn *copySection(Elf *elf, Elf *outElf, Elf64_Section index, bool cop
 	if (index >= SectionsCount)
 		LOG_ERR("Try to copy section that is out range (%d/%ld)", index, SectionsCount);
 
-	size_t shstrndx;
 	GElf_Shdr newShdr;
-	GElf_Shdr oldShdr;
-	GElf_Shdr strshdr;
-	elf_getshdrstrndx(elf, &shstrndx);
-	Elf_Scn *strtabScn = getSectionByName(outElf, ".shstrtab");
-	Elf_Data *strData = elf_getdata(strtabScn, NULL);
-	gelf_getshdr(strtabScn, &strshdr);
+	GElf_Shdr oldShdr = getSectionHeader(elf, index);
 	Elf_Scn *oldScn = elf_getscn(elf, index);
 	Elf_Data *oldData = elf_getdata(oldScn, NULL);
 	Elf_Scn *newScn = elf_newscn(outElf);
 	Elf_Data *newData = elf_newdata(newScn);
-	gelf_getshdr(oldScn, &oldShdr);
 	gelf_getshdr(newScn, &newShdr);
 	newShdr.sh_type = oldShdr.sh_type;
 	newShdr.sh_flags = oldShdr.sh_flags;
 	newShdr.sh_entsize = oldShdr.sh_entsize;
-	newShdr.sh_name = appendString(&strshdr, strData, elf_strptr(elf, shstrndx, oldShdr.sh_name));
+	newShdr.sh_name = strtabAdd(&Out.shstrtab, getSectionName(elf, index));
 	newData->d_type = oldData->d_type;
 	if (copyData)
 	{
+		// copied sections are never modified, so they share the data of the input
+		// file that stays open until the output is written
 		newShdr.sh_size = oldShdr.sh_size;
-		newData->d_buf = calloc(1, oldData->d_size);
-		CHECK_ALLOC(newData->d_buf);
+		newData->d_buf = oldData->d_buf;
 		newData->d_size = oldData->d_size;
-		if (oldData->d_buf)
-			memcpy(newData->d_buf, oldData->d_buf, oldData->d_size);
+		if (newData->d_buf == NULL)
+		{
+			newData->d_buf = calloc(1, oldData->d_size);
+			CHECK_ALLOC(newData->d_buf);
+		}
 	}
 	gelf_update_shdr(newScn, &newShdr);
-	gelf_update_shdr(strtabScn, &strshdr);
 
 	CopiedScnMap[index] = newScn;
 	return newScn;
 }
 
-static Elf64_Word copyStrtabItem(Elf *elf, Elf *outElf, size_t offset)
+static Elf64_Word copyStrtabItem(Elf *elf, size_t offset)
 {
-	GElf_Shdr strshdr;
-	Elf_Scn *strtabScn = getSectionByName(outElf, ".strtab");
-	Elf_Data *strData = elf_getdata(strtabScn, NULL);
-	gelf_getshdr(strtabScn, &strshdr);
-	size_t strtabIdx = elf_ndxscn(getSectionByName(elf, ".strtab"));
+	size_t strtabIdx = elf_ndxscn(getElfIndex(elf)->strtabScn);
 	char *text = elf_strptr(elf, strtabIdx, offset);
-	Elf64_Word newStrOffset = appendString(&strshdr, strData, text);
+	return strtabAdd(&Out.strtab, text);
+}
+
+// Change symbol indexes in all output relocations according to the "newIndex" map
+static void remapRelocationSymbols(const size_t *newIndex, size_t count)
+{
+	for (size_t i = 0; i < Out.relasCount; i++)
+	{
+		RelaVector *vec = &Out.relas[i];
+		for (size_t j = 0; j < vec->count; j++)
+		{
+			GElf_Rela *rela = &vec->relas[j];
+			size_t symIndex = ELF64_R_SYM(rela->r_info);
+			if (symIndex < count)
+				rela->r_info = ELF64_R_INFO(newIndex[symIndex], ELF64_R_TYPE(rela->r_info));
+		}
+	}
+}
+
+// Move local symbols before the others, keeping the order within both groups
+static void sortSymtab(void)
+{
+	size_t cnt = Out.symsCount;
+	size_t *newIndex = calloc(cnt + 1, sizeof(size_t));
+	CHECK_ALLOC(newIndex);
+
+	size_t localsCount = 0;
+	for (size_t i = 0; i < cnt; i++)
+	{
+		if (ELF64_ST_BIND(Out.syms[i].st_info) == STB_LOCAL)
+			localsCount++;
+	}
+
+	bool changed = false;
+	size_t nextLocal = 0;
+	size_t nextGlobal = localsCount;
+	for (size_t i = 0; i < cnt; i++)
+	{
+		if (ELF64_ST_BIND(Out.syms[i].st_info) == STB_LOCAL)
+			newIndex[i] = nextLocal++;
+		else
+			newIndex[i] = nextGlobal++;
+		changed |= newIndex[i] != i;
+	}
+
+	if (changed)
+	{
+		GElf_Sym *syms = calloc(Out.symsCapacity, sizeof(GElf_Sym));
+		CHECK_ALLOC(syms);
+		for (size_t i = 0; i < cnt; i++)
+			syms[newIndex[i]] = Out.syms[i];
+		free(Out.syms);
+		Out.syms = syms;
+		remapRelocationSymbols(newIndex, cnt);
+		for (size_t i = 0; i < SymbolsCount; i++)
+		{
+			if (Symbols[i].copiedIndex != 0 && Symbols[i].copiedIndex < cnt)
+				Symbols[i].copiedIndex = newIndex[Symbols[i].copiedIndex];
+		}
+	}
+
+	Out.localSymsCount = localsCount;
+	free(newIndex);
+}
+
+static size_t addOutSymbol(const GElf_Sym *sym)
+{
+	if (Out.symsCount == Out.symsCapacity)
+	{
+		Out.symsCapacity *= 2;
+		Out.syms = realloc(Out.syms, Out.symsCapacity * sizeof(GElf_Sym));
+		CHECK_ALLOC(Out.syms);
+	}
+	Out.syms[Out.symsCount] = *sym;
+	return Out.symsCount++;
+}
+
+static void reserveOutRelocations(RelaVector *vec, size_t count)
+{
+	if (vec->count + count <= vec->capacity)
+		return;
+	size_t capacity = vec->capacity ? vec->capacity : count;
+	while (capacity < vec->count + count)
+		capacity *= 2;
+	vec->relas = realloc(vec->relas, capacity * sizeof(GElf_Rela));
+	CHECK_ALLOC(vec->relas);
+	vec->capacity = capacity;
+}
+
+static size_t copySymbol(Elf *elf, Elf *outElf, size_t index, bool copySec)
+{
+	GElf_Sym oldSym;
+	GElf_Sym newSym;
+
+	if (Symbols[index].copiedIndex)
+		return Symbols[index].copiedIndex;
+
+	oldSym = getElfIndex(elf)->syms[index];
+	newSym = oldSym;
+
+	char symType = ELF64_ST_TYPE(oldSym.st_info);
+	if (oldSym.st_shndx > 0 && oldSym.st_shndx < SectionsCount &&
+		copySec)
+	{
+		Elf_Scn *scn = copySection(elf, outElf, oldSym.st_shndx, true);
+		newSym.st_shndx = elf_ndxscn(scn);
+
+		if (oldSym.st_name != 0)
+		{
+			newSym.st_info = ELF64_ST_INFO(STB_GLOBAL, symType);
+			// TODO: Avoid modify symbol name for functions
+			if (symType == STT_FUNC)
+			{
+				char *symName = strdup(Symbols[index].name);
+				CHECK_ALLOC(symName);
+				char *n;
+				while ((n = strchr(symName, '.')) != NULL)
+					*n = '_';
+				newSym.st_name = strtabAdd(&Out.strtab, symName);
+
+				free(symName);
+			}
+			else
+			{
+				newSym.st_name = strtabAdd(&Out.strtab, Symbols[index].name);
+			}
+		}
+	}
+	else // mark symbol as "external"
+	{
+		if (symType == STT_OBJECT && oldSym.st_name != 0)
+		{
+			if (strstr(getSectionName(elf, oldSym.st_shndx), ".read_mostly"))
+			{
+				fprintf(stderr, "ERROR (%s:%d): Changes to the source code " \
+						"affects the %s variable marked with the " \
+						"__read_mostly macro. This is not yet supported by " \
+						"DEKU.\n", __FILE__, __LINE__, Symbols[index].name);
+				exit(ERROR_UNSUPPORTED_READ_MOSTLY);
+			}
+		}
+		if (oldSym.st_shndx > 0 && oldSym.st_shndx < SectionsCount)
+			newSym.st_shndx = 0;
+		newSym.st_size = 0;
+		newSym.st_info = ELF64_ST_INFO(STB_GLOBAL, symType);
+		if (oldSym.st_name != 0)
+			newSym.st_name = copyStrtabItem(elf, oldSym.st_name);
+	}
 
-	gelf_update_shdr(strtabScn, &strshdr);
-	return newStrOffset;
+	size_t newIndex = addOutSymbol(&newSym);
+	Symbols[index].copiedIndex = newIndex;
+	return newIndex;
 }
 
-static void swapSymbolIndex(Elf *elf, size_t left, size_t right)
+static void copyRelSection(Elf *elf, Elf *outElf, Elf64_Section index, size_t relTo, GElf_Sym *fromSym)
+{
+	Elf_Scn *outScn = copySection(elf, outElf, index, false);
+	GElf_Shdr shdr;
+	gelf_getshdr(outScn, &shdr);
+	shdr.sh_link = elf_ndxscn(Out.symtabScn);
+	shdr.sh_info = relTo;
+	gelf_update_shdr(outScn, &shdr);
+
+	RelaVector *vec = &Out.relas[index];
+	vec->scn = outScn;
+	Elf64_Section target = getSectionHeader(elf, index).sh_info;
+	size_t cnt;
+	const GElf_Rela *relas;
+	if (fromSym != NULL)
+		relas = getRelocationsInRange(elf, target, fromSym->st_value,
+									  fromSym->st_value + fromSym->st_size + 1, &cnt);
+	else
+		relas = getRelocations(elf, target, &cnt);
+	reserveOutRelocations(vec, cnt);
+	for (size_t i = 0; i < cnt; i++)
+	{
+		GElf_Rela rela = relas[i];
+		size_t newSymIndex;
+		size_t symIndex = ELF64_R_SYM(rela.r_info);
+		GElf_Shdr shdr = getSectionHeader(elf, Symbols[symIndex].secIndex);
+		const char *secName = getSectionName(elf, Symbols[symIndex].secIndex);
+		if (shdr.sh_flags & SHF_STRINGS ||
+			strstr(secName, ".rodata.__func__") == secName)
+		{
+			newSymIndex = copySymbol(elf, outElf, symIndex, true);
+		}
+		else
+		{
+			Symbol *sym = fromSym == NULL ? &Symbols[symIndex] : getSymbolForRelocation(rela);
+			bool isFuncOrVar = Symbols[sym->index].isFun || Symbols[sym->index].isVar;
+			bool copySec = fromSym == NULL ? true : !isFuncOrVar;
+			newSymIndex = copySymbol(elf, outElf, sym->index, copySec);
+		}
+		rela.r_info = ELF64_R_INFO(newSymIndex, ELF64_R_TYPE(rela.r_info));
+		vec->relas[vec->count++] = rela;
+	}
+}
+
+static void copySectionWithRel(Elf *elf, Elf *outElf, Elf64_Section index, GElf_Sym *fromSym)
+{
+	Elf_Scn *newScn = copySection(elf, outElf, index, true);
+	Elf_Scn *relScn = getRelForSectionIndex(elf, index);
+	if (relScn)
+		copyRelSection(elf, outElf, elf_ndxscn(relScn), elf_ndxscn(newScn), fromSym);
+}
+
+static void copySymbols(Elf *elf, Elf *outElf, char **symbols)
+{
+	Elf_Scn *scn;
+	GElf_Sym sym;
+	size_t symIndex;
+	char **syms = symbols;
+	bool *symToCopy = calloc(sizeof(bool), SymbolsCount);
+	CHECK_ALLOC(symToCopy);
+
+	while(*syms != NULL)
+	{
+		sym = getSymbolByName(elf, *syms, &symIndex);
+		if (sym.st_name == 0)
+			LOG_ERR("Can't find symbol: %s", *syms);
+		symToCopy[symIndex] = true;
+		syms++;
+	}
+
+	for (size_t i = 0; i < SymbolsCount; i++)
+	{
+		if (!symToCopy[i])
+			continue;
+
+		sym = getSymbolByIndex(elf, i);
+		Elf_Scn *newScn = copySection(elf, outElf, sym.st_shndx, true);
+		size_t index = copySymbol(elf, outElf, i, true);
+		Out.syms[index].st_shndx = elf_ndxscn(newScn);
+	}
+
+	for (size_t i = 0; i < SymbolsCount; i++)
+	{
+		if (!symToCopy[i])
+			continue;
+
+		sym = getSymbolByIndex(elf, i);
+		copySectionWithRel(elf, outElf, sym.st_shndx, &sym);
+	}
+	const char *extraSections[] = {".altinstructions", ".altinstr_aux",
+								   ".altinstr_replacement",
+									/* needed for BUG() */ "__bug_table"
+								  };
+	for (size_t i = 0; i < sizeof(extraSections) / sizeof(*extraSections); i++)
+	{
+		scn = getSectionByName(elf, extraSections[i]);
+		if (scn)
+		{
+			LOG_DEBUG("Copy %s section", extraSections[i]);
+			size_t index = elf_ndxscn(scn);
+			copySectionWithRel(elf, outElf, index, NULL);
+		}
+	}
+	checkStaticKeys(elf, symToCopy);
+
+	// TODO: Fix file path in string sections
+
+	sortSymtab();
+	finalizeOutElf();
+
+	free(symToCopy);
+}
+
+/*
+ * Cache of opened ELF files used in the batch mode. The entry is valid as long
+ * as the file on the disk is not changed. Data of the file is read through the
+ * private mapping, so the file can be replaced by rename while the entry is in
+ * use, but it can't be rewritten in place: pages that weren't read yet would
+ * come from the new content and reading past the truncated end raises SIGBUS.
+ * Files are only rewritten between requests (e.g. by the compiler) and each
+ * request checks with isSameFile the file before the entry is used again, so
+ * a rewritten file is never read through a stale entry.
+ */
+static CachedElf *findCachedElf(const char *filePath)
+{
+	for (size_t i = 0; i < ElfCacheCount; i++)
+	{
+		if (strcmp(ElfCache[i].path, filePath) == 0)
+			return &ElfCache[i];
+	}
+	return NULL;
+}
+
+static void dropCachedElf(const char *filePath)
+{
+	CachedElf *entry = findCachedElf(filePath);
+	if (entry == NULL)
+		return;
+
+	freeElfIndex(entry->elf);
+	elf_end(entry->elf);
+	free(entry->path);
+	*entry = ElfCache[--ElfCacheCount];
+}
+
+static void freeElfCache(void)
+{
+	while (ElfCacheCount > 0)
+		dropCachedElf(ElfCache[0].path);
+	free(ElfCache);
+	ElfCache = NULL;
+	ElfCacheCapacity = 0;
+}
+
+static bool isSameFile(const CachedElf *entry, const struct stat *st)
+{
+	return entry->dev == st->st_dev && entry->ino == st->st_ino &&
+		   entry->size == st->st_size &&
+		   entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+		   entry->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+		   entry->ctime.tv_sec == st->st_ctim.tv_sec &&
+		   entry->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static Elf *getCachedElf(const char *filePath, struct stat *st)
+{
+	if (stat(filePath, st) == -1)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
+
+	CachedElf *entry = findCachedElf(filePath);
+	if (entry == NULL)
+		return NULL;
+
+	if (!isSameFile(entry, st))
+	{
+		LOG_DEBUG("File '%s' has changed since last use", filePath);
+		dropCachedElf(filePath);
+		return NULL;
+	}
+
+	entry->lastUse = ++ElfCacheClock;
+	entry->refs++;
+	return entry->elf;
+}
+
+static void addCachedElf(const char *filePath, const struct stat *st, Elf *elf)
+{
+	// files in use are never dropped, so the cache can grow above the limit
+	if (ElfCacheCount >= ELF_CACHE_SIZE)
+	{
+		CachedElf *oldest = NULL;
+		for (size_t i = 0; i < ElfCacheCount; i++)
+		{
+			if (ElfCache[i].refs == 0 && (oldest == NULL || ElfCache[i].lastUse < oldest->lastUse))
+				oldest = &ElfCache[i];
+		}
+		if (oldest != NULL)
+			dropCachedElf(oldest->path);
+	}
+
+	if (ElfCacheCount == ElfCacheCapacity)
+	{
+		ElfCacheCapacity = ElfCacheCapacity ? ElfCacheCapacity * 2 : ELF_CACHE_SIZE;
+		ElfCache = realloc(ElfCache, ElfCacheCapacity * sizeof(CachedElf));
+		CHECK_ALLOC(ElfCache);
+	}
+
+	CachedElf *entry = &ElfCache[ElfCacheCount++];
+	entry->path = strdup(filePath);
+	CHECK_ALLOC(entry->path);
+	entry->dev = st->st_dev;
+	entry->ino = st->st_ino;
+	entry->size = st->st_size;
+	entry->mtime = st->st_mtim;
+	entry->ctime = st->st_ctim;
+	entry->lastUse = ++ElfCacheClock;
+	entry->refs = 1;
+	entry->elf = elf;
+}
+
+static void releaseCachedElf(Elf *elf)
+{
+	for (size_t i = 0; i < ElfCacheCount; i++)
+	{
+		if (ElfCache[i].elf == elf && ElfCache[i].refs > 0)
+		{
+			ElfCache[i].refs--;
+			return;
+		}
+	}
+}
+
+static Elf *openElf(const char *filePath, int *fd)
+{
+	struct stat st;
+	if (BatchMode)
+	{
+		Elf *elf = getCachedElf(filePath, &st);
+		if (elf != NULL)
+		{
+			*fd = -1;
+			return elf;
+		}
+	}
+
+	*fd = open(filePath, O_RDONLY);
+	if (*fd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
+
+	// section data is read directly from the mapped file. The mapping is private,
+	// so the data can be patched in memory without touching the file
+	Elf *elf = elf_begin(*fd, ELF_C_READ_MMAP_PRIVATE, NULL);
+	if (elf == NULL)
+		error(EXIT_FAILURE, errno, "Problems opening '%s' as ELF file: %s",
+			  filePath, elf_errmsg(-1));
+
+	size_t shstrndx;
+	if (elf_getshdrstrndx(elf, &shstrndx))
+		error(EXIT_FAILURE, errno, "Cannot get section header string index in %s", filePath);
+
+	// build section and symbol tables, fail if .strtab or .symtab is missing
+	getElfIndex(elf);
+
+	// the mapping outlives the descriptor, the file is read into memory only if mmap failed
+	if (BatchMode)
+	{
+		if (elf_cntl(elf, ELF_C_FDREAD) != 0)
+			LOG_ERR("Failed to read '%s': %s", filePath, elf_errmsg(-1));
+		close(*fd);
+		*fd = -1;
+		addCachedElf(filePath, &st, elf);
+	}
+
+	return elf;
+}
+
+static void closeElf(Elf *elf, int fd)
+{
+	// cached files are closed at the end of the batch
+	if (fd == -1)
+	{
+		releaseCachedElf(elf);
+		return;
+	}
+
+	freeElfIndex(elf);
+	elf_end(elf);
+	close(fd);
+}
+
+/*
+ * Build call graph of functions. Callees of the function are taken from the
+ * relocations inside the function, in the order of the first reference.
+ */
+static void buildCallGraph(Elf *elf, CallGraph *callees, CallGraph *callers)
+{
+	// mark of the last function that referenced the callee, used to skip duplicates
+	size_t *lastCaller = calloc(SymbolsCount + 1, sizeof(size_t));
+	CHECK_ALLOC(lastCaller);
+	size_t edgesCount = 0;
+	size_t edgesCapacity = SymbolsCount + 1;
+	callees->offsets = calloc(SymbolsCount + 1, sizeof(size_t));
+	CHECK_ALLOC(callees->offsets);
+	callees->edges = malloc(edgesCapacity * sizeof(size_t));
+	CHECK_ALLOC(callees->edges);
+
+	for (size_t i = 0; i < SymbolsCount; i++)
+	{
+		callees->offsets[i] = edgesCount;
+		Symbol *s = &Symbols[i];
+		if (!s->isFun)
+			continue;
+
+		size_t cnt;
+		const GElf_Rela *relas = getRelocationsInRange(elf, s->secIndex, s->st_value,
+												 s->st_value + s->st_size, &cnt);
+		for (size_t j = 0; j < cnt; j++)
+		{
+			size_t symIndex = ELF64_R_SYM(relas[j].r_info);
+			if (symIndex >= SymbolsCount)
+				LOG_ERR("Invalid symbol index: %ld in relocations for section %ld", symIndex, s->secIndex);
+			Symbol *sym = getSymbolForRelocation(relas[j]);
+			if (!sym->isFun || lastCaller[sym->index] == i + 1)
+				continue;
+			lastCaller[sym->index] = i + 1;
+			if (edgesCount == edgesCapacity)
+			{
+				edgesCapacity *= 2;
+				callees->edges = realloc(callees->edges, edgesCapacity * sizeof(size_t));
+				CHECK_ALLOC(callees->edges);
+			}
+			callees->edges[edgesCount++] = sym->index;
+		}
+	}
+	callees->offsets[SymbolsCount] = edgesCount;
+	free(lastCaller);
+
+	// reverse the graph
+	callers->offsets = calloc(SymbolsCount + 2, sizeof(size_t));
+	CHECK_ALLOC(callers->offsets);
+	callers->edges = malloc((edgesCount + 1) * sizeof(size_t));
+	CHECK_ALLOC(callers->edges);
+	for (size_t i = 0; i < edgesCount; i++)
+		callers->offsets[callees->edges[i] + 2]++;
+	for (size_t i = 2; i <= SymbolsCount + 1; i++)
+		callers->offsets[i] += callers->offsets[i - 1];
+	for (size_t i = 0; i < SymbolsCount; i++)
+	{
+		for (size_t j = callees->offsets[i]; j < callees->offsets[i + 1]; j++)
+			callers->edges[callers->offsets[callees->edges[j] + 1]++] = i;
+	}
+}
+
+static void freeCallGraph(CallGraph *graph)
+{
+	free(graph->offsets);
+	free(graph->edges);
+}
+
+static void printPath(const size_t *path, size_t depth)
+{
+	for (size_t i = 0; i < depth; i++)
+		printf(i == 0 ? "%s" : " %s", Symbols[path[i]].name);
+	puts("");
+}
+
+/*
+ * Print every call chain that starts with a function without callees and
+ * goes up to "fun". Every function is visited only once, so the chain that
+ * reaches already visited function is not printed.
+ */
+static void printCallees(const CallGraph *callees, size_t fun, size_t *path, size_t depth,
+						 bool *visited)
+{
+	if (visited[fun])
+		return;
+	visited[fun] = true;
+
+	path[depth++] = fun;
+	if (callees->offsets[fun] == callees->offsets[fun + 1])
+	{
+		for (size_t i = depth; i-- > 0;)
+			printf("%s ", Symbols[path[i]].name);
+		puts("");
+		return;
+	}
+	for (size_t i = callees->offsets[fun]; i < callees->offsets[fun + 1]; i++)
+		printCallees(callees, callees->edges[i], path, depth, visited);
+}
+
+/*
+ * Print chains of callers that starts with "fun" and ends on the first
+ * function marked in "stop". Function that has been already walked through
+ * is not walked again, instead the chain is completed with the first chain
+ * found for that function. It keeps the output linear to the graph size.
+ * Function without chains is walked again if it was reached through a
+ * function on the path, as that function could have chains on other paths.
+ * "cycle" is set to the lowest position on the path of such function.
+ */
+static bool walkCallerChains(const CallGraph *callers, size_t fun, size_t depth, ChainWalk *walk,
+							 size_t *cycle)
+{
+	walk->path[depth++] = fun;
+	if (depth > 1 && walk->stop[fun])
+	{
+		printPath(walk->path, depth);
+		return true;
+	}
+
+	walk->state[fun] = CHAIN_ON_PATH;
+	walk->depth[fun] = depth - 1;
+	size_t lowest = SIZE_MAX;
+	bool reaches = false;
+	for (size_t i = callers->offsets[fun]; i < callers->offsets[fun + 1]; i++)
+	{
+		size_t caller = callers->edges[i];
+		if (walk->stop[caller] || walk->state[caller] == CHAIN_UNVISITED)
+		{
+			if (!walkCallerChains(callers, caller, depth, walk, &lowest))
+				continue;
+		}
+		else if (walk->state[caller] == CHAIN_REACHES)
+		{
+			size_t d = depth;
+			for (size_t n = caller; ; n = walk->next[n])
+			{
+				walk->path[d++] = n;
+				if (walk->stop[n])
+					break;
+			}
+			printPath(walk->path, d);
+		}
+		else
+		{
+			if (walk->state[caller] == CHAIN_ON_PATH && walk->depth[caller] < lowest)
+				lowest = walk->depth[caller];
+			continue;
+		}
+		if (!reaches)
+			walk->next[fun] = caller;
+		reaches = true;
+	}
+	if (reaches)
+	{
+		walk->state[fun] = CHAIN_REACHES;
+	}
+	else if (lowest < depth - 1)
+	{
+		walk->state[fun] = CHAIN_UNVISITED;
+		if (lowest < *cycle)
+			*cycle = lowest;
+	}
+	else
+	{
+		walk->state[fun] = CHAIN_DEAD;
+	}
+	return reaches;
+}
+
+// Find the shortest call path from "from" to "to" and print it
+static bool printCallPath(const CallGraph *callees, size_t from, size_t to)
+{
+	size_t *prev = malloc((SymbolsCount + 1) * sizeof(size_t));
+	CHECK_ALLOC(prev);
+	size_t *queue = malloc((SymbolsCount + 1) * sizeof(size_t));
+	CHECK_ALLOC(queue);
+	for (size_t i = 0; i < SymbolsCount; i++)
+		prev[i] = SIZE_MAX;
+
+	size_t head = 0;
+	size_t tail = 0;
+	queue[tail++] = from;
+	prev[from] = from;
+	while (head < tail && prev[to] == SIZE_MAX)
+	{
+		size_t fun = queue[head++];
+		for (size_t i = callees->offsets[fun]; i < callees->offsets[fun + 1]; i++)
+		{
+			size_t callee = callees->edges[i];
+			if (prev[callee] != SIZE_MAX)
+				continue;
+			prev[callee] = fun;
+			queue[tail++] = callee;
+		}
+	}
+
+	bool found = prev[to] != SIZE_MAX;
+	if (found)
+	{
+		// reuse the queue to reverse the path
+		size_t depth = 0;
+		for (size_t n = to; n != from; n = prev[n])
+			queue[depth++] = n;
+		queue[depth++] = from;
+		for (size_t i = 0; i < depth / 2; i++)
+		{
+			size_t tmp = queue[i];
+			queue[i] = queue[depth - 1 - i];
+			queue[depth - 1 - i] = tmp;
+		}
+		printPath(queue, depth);
+	}
+	free(prev);
+	free(queue);
+	return found;
+}
+
+// Get index of the first function with given name
+static size_t getFunctionIndex(Elf *elf, const char *name)
+{
+	for (size_t i = findSymbolByName(elf, name, 0); i != 0; i = findSymbolByName(elf, name, i))
+	{
+		if (Symbols[i].isFun)
+			return i;
+	}
+	LOG_ERR("Can't find function: %s", name);
+}
+
+static void help(const char *execName)
+{
+	error(EXIT_FAILURE, EINVAL, "Usage: %s [-diff|--callchain|--extract|--changeCallSymbol|--benchmarkFingerprint|--sympos|--symsToRelocate|--traceable|--finalize|--fingerprint|--batch"
+#ifdef SUPPORT_DISASSEMBLE
+	"|--disassemble"
+#endif
+	"] ...", execName);
+}
+
+static void *workerThread(void *arg)
+{
+	WorkQueue *queue = arg;
+	size_t i;
+	while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->count)
+		queue->run(queue->tasks, i);
+	return NULL;
+}
+
+// Run all tasks from the queue on the given number of threads
+static void runWorkQueue(WorkQueue *queue, size_t threadsCount)
+{
+	queue->next = 0;
+	if (threadsCount > queue->count)
+		threadsCount = queue->count;
+	if (threadsCount <= 1)
+	{
+		workerThread(queue);
+		return;
+	}
+
+	pthread_t *threads = calloc(threadsCount, sizeof(pthread_t));
+	CHECK_ALLOC(threads);
+	for (size_t i = 0; i < threadsCount; i++)
+	{
+		if (pthread_create(&threads[i], NULL, workerThread, queue) != 0)
+			LOG_ERR("Failed to create worker thread");
+	}
+	for (size_t i = 0; i < threadsCount; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+/*
+ * libelf and the ELF index read sections data and relocations on first use.
+ * Load everything up front, so the ELF can be read from many threads at once.
+ */
+static void preloadElf(void *elfs, size_t index)
+{
+	Elf *elf = ((Elf **)elfs)[index];
+	ElfIndex *elfIndex = getElfIndex(elf);
+	for (size_t i = 1; i < elfIndex->sectionsCount; i++)
+	{
+		Elf_Scn *scn = elf_getscn(elf, i);
+		elf_rawdata(scn, NULL);
+		elf_getdata(scn, NULL);
+		size_t cnt;
+		getRelocations(elf, i, &cnt);
+	}
+}
+
+static void diffChunk(void *chunks, size_t index)
+{
+	DiffChunk *chunk = &((DiffChunk *)chunks)[index];
+	FILE *out = open_memstream(&chunk->out, &chunk->outSize);
+	CHECK_ALLOC(out);
+	findModifiedSymbols(chunk->pair, chunk->start, chunk->end, out);
+	fclose(out);
+}
+
+static int showDiff(int argc, char *argv[])
+{
+	// every pair takes at least four arguments
+	const char **firstFiles = calloc(argc / 4 + 1, sizeof(char *));
+	CHECK_ALLOC(firstFiles);
+	const char **secondFiles = calloc(argc / 4 + 1, sizeof(char *));
+	CHECK_ALLOC(secondFiles);
+	const char **labels = calloc(argc / 4 + 1, sizeof(char *));
+	CHECK_ALLOC(labels);
+	const char **kernelFiles = calloc(argc / 4 + 1, sizeof(char *));
+	CHECK_ALLOC(kernelFiles);
+	const char *vmlinuxFile = NULL;
+	size_t firstCount = 0;
+	size_t secondCount = 0;
+	size_t labelsCount = 0;
+	size_t kernelCount = 0;
+	long threadsCount = sysconf(_SC_NPROCESSORS_ONLN);
+	bool records = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "a:b:l:k:m:H:j:r")) != -1)
+	{
+		switch (opt)
+		{
+		case 'r':
+			records = true;
+			break;
+		case 'k':
+			kernelFiles[kernelCount++] = optarg;
+			break;
+		case 'm':
+			vmlinuxFile = optarg;
+			break;
+		case 'a':
+			firstFiles[firstCount++] = optarg;
+			break;
+		case 'b':
+			secondFiles[secondCount++] = optarg;
+			break;
+		case 'l':
+			labels[labelsCount++] = optarg;
+			break;
+		case 'H':
+			Fingerprint = getFingerprintEngine(optarg);
+			if (Fingerprint == NULL)
+				error(EXIT_FAILURE, EINVAL, "Unknown fingerprint: %s", optarg);
+			break;
+		case 'j':
+			threadsCount = atol(optarg);
+			break;
+		}
+	}
+
+	if (firstCount == 0 || firstCount != secondCount ||
+		(labelsCount != 0 && labelsCount != firstCount) ||
+		(kernelCount != 0 && kernelCount != firstCount) || threadsCount <= 0)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to show difference between objects file. Valid parameters:"
+			  "-a <ELF_FILE|FINGERPRINT_DB> -b <ELF_FILE> [-l <LABEL>] [-k <KERNEL_ELF_FILE>] "
+			  "[-a <ELF_FILE|FINGERPRINT_DB> -b <ELF_FILE> [-l <LABEL>] [-k <KERNEL_ELF_FILE>]]... "
+			  "[-m <VMLINUX>] [-j <THREADS>] [-H crc32|crc32c|crc32c-soft|hash64] [-r] [-V]");
+
+	int vmlinuxFd = -1;
+	Elf *vmlinuxElf = vmlinuxFile != NULL ? openElf(vmlinuxFile, &vmlinuxFd) : NULL;
+
+	size_t pairsCount = firstCount;
+	DiffPair *pairs = calloc(pairsCount, sizeof(DiffPair));
+	CHECK_ALLOC(pairs);
+	Elf **elfs = calloc(pairsCount * 2, sizeof(Elf *));
+	CHECK_ALLOC(elfs);
+	size_t elfsCount = 0;
+	size_t chunksCount = 0;
+	for (size_t i = 0; i < pairsCount; i++)
+	{
+		DiffPair *pair = &pairs[i];
+		pair->firstFile = firstFiles[i];
+		pair->secondFile = secondFiles[i];
+		pair->label = labelsCount ? labels[i] : secondFiles[i];
+		pair->records = records;
+		pthread_mutex_init(&pair->callSitesLock, NULL);
+		if (isFingerprintDb(pair->firstFile))
+			pair->firstDb = loadFingerprintDb(pair->firstFile);
+		else
+			pair->firstElf = openElf(pair->firstFile, &pair->firstFd);
+		pair->secondElf = openElf(pair->secondFile, &pair->secondFd);
+		if (kernelCount != 0)
+			pair->kernelElf = openElf(kernelFiles[i], &pair->kernelFd);
+		pair->vmlinuxElf = vmlinuxElf;
+		// the same file can be opened once in the batch mode
+		Elf *pairElfs[] = { pair->firstElf, pair->secondElf };
+		for (size_t j = 0; j < 2; j++)
+		{
+			if (pairElfs[j] == NULL)
+				continue;
+			size_t k = 0;
+			while (k < elfsCount && elfs[k] != pairElfs[j])
+				k++;
+			if (k == elfsCount)
+				elfs[elfsCount++] = pairElfs[j];
+		}
+		size_t symCount = getElfIndex(pair->secondElf)->symCount;
+		chunksCount += (symCount + DIFF_CHUNK_SYMBOLS - 1) / DIFF_CHUNK_SYMBOLS;
+	}
+
+	DiffChunk *chunks = calloc(chunksCount, sizeof(DiffChunk));
+	CHECK_ALLOC(chunks);
+	size_t chunk = 0;
+	for (size_t i = 0; i < pairsCount; i++)
+	{
+		size_t symCount = getElfIndex(pairs[i].secondElf)->symCount;
+		for (size_t start = 0; start < symCount; start += DIFF_CHUNK_SYMBOLS)
+		{
+			chunks[chunk].pair = &pairs[i];
+			chunks[chunk].start = start;
+			chunks[chunk].end = start + DIFF_CHUNK_SYMBOLS;
+			chunk++;
+		}
+	}
+
+	WorkQueue preload = { .run = preloadElf, .tasks = elfs, .count = elfsCount };
+	runWorkQueue(&preload, threadsCount);
+	WorkQueue diff = { .run = diffChunk, .tasks = chunks, .count = chunksCount };
+	runWorkQueue(&diff, threadsCount);
+
+	// results are printed in the order of pairs, labeled if there is more than one pair
+	chunk = 0;
+	for (size_t i = 0; i < pairsCount; i++)
+	{
+		if (pairsCount > 1 || labelsCount > 0)
+			printf("File: %s\n", pairs[i].label);
+		for (; chunk < chunksCount && chunks[chunk].pair == &pairs[i]; chunk++)
+		{
+			fwrite(chunks[chunk].out, 1, chunks[chunk].outSize, stdout);
+			free(chunks[chunk].out);
+		}
+	}
+
+	for (size_t i = 0; i < pairsCount; i++)
+	{
+		if (pairs[i].firstDb != NULL)
+			freeFingerprintDb(pairs[i].firstDb);
+		else
+			closeElf(pairs[i].firstElf, pairs[i].firstFd);
+		closeElf(pairs[i].secondElf, pairs[i].secondFd);
+		if (pairs[i].kernelElf != NULL)
+			closeElf(pairs[i].kernelElf, pairs[i].kernelFd);
+		free(pairs[i].callSites[0].sites);
+		free(pairs[i].callSites[1].sites);
+		pthread_mutex_destroy(&pairs[i].callSitesLock);
+	}
+	if (vmlinuxElf != NULL)
+		closeElf(vmlinuxElf, vmlinuxFd);
+	free(chunks);
+	free(elfs);
+	free(pairs);
+	free(kernelFiles);
+	free(labels);
+	free(secondFiles);
+	free(firstFiles);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Write fingerprints of all functions and variables of the object. --diff
+ * accepts the file in place of the first object, so the pristine object does
+ * not have to be hashed on every run.
+ */
+static int writeFingerprints(int argc, char *argv[])
+{
+	char *filePath = NULL;
+	char *outFile = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:o:H:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			filePath = strdup(optarg);
+			break;
+		case 'o':
+			outFile = strdup(optarg);
+			break;
+		case 'H':
+			Fingerprint = getFingerprintEngine(optarg);
+			if (Fingerprint == NULL)
+				error(EXIT_FAILURE, EINVAL, "Unknown fingerprint: %s", optarg);
+			break;
+		}
+	}
+
+	if (filePath == NULL || outFile == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to write fingerprints. Valid parameters:"
+			  "-f <ELF_FILE> -o <OUT_FILE> [-H crc32|crc32c|crc32c-soft|hash64] [-V]");
+
+	int fd;
+	Elf *elf = openElf(filePath, &fd);
+	ElfIndex *index = getElfIndex(elf);
+	size_t sitesCount;
+	CallSite *sites = findRecordedCallSites(elf, &sitesCount);
+	FingerprintEntry *entries = calloc(index->symCount + 1, sizeof(FingerprintEntry));
+	CHECK_ALLOC(entries);
+	const char **names = calloc(index->symCount + 1, sizeof(char *));
+	CHECK_ALLOC(names);
+	size_t entriesCount = 0;
+	size_t stringsSize = 0;
+	for (size_t i = 1; i < index->symCount; i++)
+	{
+		GElf_Sym sym = index->syms[i];
+		const char *name = index->symbols.names[i];
+		uint8_t type = ELF64_ST_TYPE(sym.st_info);
+		if (name[0] == '\0' || (type != STT_FUNC && type != STT_OBJECT))
+			continue;
+		// keep only the symbol that --diff would find by name
+		GElf_Sym first;
+		if (!getSymbolByNameAndType(elf, name, type, &first) ||
+			memcmp(&first, &sym, sizeof(sym)) != 0)
+			continue;
+
+		names[entriesCount] = name;
+		FingerprintEntry *entry = &entries[entriesCount++];
+		entry->size = sym.st_size;
+		entry->name = stringsSize;
+		entry->type = type;
+		stringsSize += strlen(name) + 1;
+		if (type != STT_FUNC || sym.st_shndx == SHN_UNDEF || sym.st_shndx >= index->sectionsCount)
+			continue;
+		if (sym.st_size > 0 && index->shdrs[sym.st_shndx].sh_type == SHT_PROGBITS)
+			entry->hash = calcSymHash(elf, &sym);
+		entry->funClass = sectionClass(getSectionName(elf, sym.st_shndx));
+		entry->traceable = isTraceableSymbol(elf, &sym, sites, sitesCount);
+	}
+
+	FingerprintDbHeader header = { .entriesCount = entriesCount, .stringsSize = stringsSize };
+	memcpy(header.magic, FINGERPRINT_DB_MAGIC, sizeof(header.magic));
+	// the name is padded with zeros, it is not terminated if it fills the field
+	memcpy(header.engine, Fingerprint->name, strnlen(Fingerprint->name, sizeof(header.engine)));
+	dropCachedElf(outFile);
+	FILE *f = fopen(outFile, "w");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot create file '%s'", outFile);
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(entries, sizeof(FingerprintEntry), entriesCount, f);
+	for (size_t i = 0; i < entriesCount; i++)
+		fwrite(names[i], 1, strlen(names[i]) + 1, f);
+	if (fclose(f) != 0)
+		error(EXIT_FAILURE, errno, "Cannot write file '%s'", outFile);
+
+	LOG_DEBUG("%zu fingerprints written to %s", entriesCount, outFile);
+	free(names);
+	free(entries);
+	free(sites);
+	closeElf(elf, fd);
+	free(outFile);
+	free(filePath);
+	return EXIT_SUCCESS;
+}
+
+static double elapsedSeconds(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int benchmarkFingerprint(int argc, char *argv[])
+{
+	char *filePath = NULL;
+	int rounds = 100;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:n:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			filePath = strdup(optarg);
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		}
+	}
+
+	if (filePath == NULL || rounds <= 0)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to benchmark fingerprints. Valid parameters:"
+			  "-f <ELF_FILE> [-n <ROUNDS>]");
+
+	int fd;
+	Elf *elf = openElf(filePath, &fd);
+	ElfIndex *index = getElfIndex(elf);
+	GElf_Sym *funs = calloc(index->symCount + 1, sizeof(GElf_Sym));
+	CHECK_ALLOC(funs);
+	const uint8_t **bodies = calloc(index->symCount + 1, sizeof(uint8_t *));
+	CHECK_ALLOC(bodies);
+	size_t funsCount = 0;
+	size_t bytes = 0;
+	for (size_t i = 0; i < index->symCount; i++)
+	{
+		GElf_Sym sym = index->syms[i];
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FUNC && sym.st_size > 0 &&
+			sym.st_shndx < index->sectionsCount &&
+			index->shdrs[sym.st_shndx].sh_type == SHT_PROGBITS)
+		{
+			Elf_Data *data = elf_rawdata(elf_getscn(elf, sym.st_shndx), NULL);
+			bodies[funsCount] = (uint8_t *)data->d_buf + sym.st_value;
+			funs[funsCount++] = sym;
+			bytes += sym.st_size;
+		}
+	}
+
+	LOG_INFO("%zu functions, %zu bytes, %d rounds", funsCount, bytes, rounds);
+	LOG_INFO("%-12s %12s %16s", "fingerprint", "body MB/s", "full ns/function");
+	for (size_t e = 0; e < sizeof(FingerprintEngines) / sizeof(*FingerprintEngines); e++)
+	{
+		Fingerprint = &FingerprintEngines[e];
+		uint64_t sum = 0;
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < funsCount; i++)
+				sum += Fingerprint->hash(bodies[i], funs[i].st_size);
+		}
+		double bodyTime = elapsedSeconds(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < funsCount; i++)
+				sum += calcSymHash(elf, &funs[i]);
+		}
+		double fullTime = elapsedSeconds(&start);
+
+		LOG_INFO("%-12s %12.1f %16.1f", Fingerprint->name,
+				 bodyTime > 0 ? bytes * (double)rounds / bodyTime / 1e6 : 0.0,
+				 funsCount ? fullTime * 1e9 / ((double)funsCount * rounds) : 0.0);
+		LOG_DEBUG("checksum: %lx", sum);
+	}
+
+	free(bodies);
+	free(funs);
+	closeElf(elf, fd);
+	free(filePath);
+	return EXIT_SUCCESS;
+}
+
+static int findCallChains(int argc, char *argv[])
+{
+	char *filePath = NULL;
+	char *callersOf = NULL;
+	char *chainsOf = NULL;
+	char *pristineFile = NULL;
+	char *pathFrom = NULL;
+	char *pathTo = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:c:u:p:r:t:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			filePath = strdup(optarg);
+			break;
+		case 'c':
+			callersOf = strdup(optarg);
+			break;
+		case 'u':
+			chainsOf = strdup(optarg);
+			break;
+		case 'p':
+			pristineFile = strdup(optarg);
+			break;
+		case 'r':
+			pathFrom = strdup(optarg);
+			break;
+		case 't':
+			pathTo = strdup(optarg);
+			break;
+		}
+	}
+
+	if (filePath == NULL || (chainsOf != NULL && pristineFile == NULL) ||
+		((pathFrom == NULL) != (pathTo == NULL)))
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to print call chain. Valid parameters:"
+			  "-f <ELF_FILE> [-c <FUNCTION> | -u <FUNCTION> -p <PRISTINE_ELF_FILE> | "
+			  "-r <FROM_FUNCTION> -t <TO_FUNCTION>]");
+
+	int fd;
+	Elf *elf = openElf(filePath, &fd);
+	readSymbols(elf);
+	CallGraph callees;
+	CallGraph callers;
+	buildCallGraph(elf, &callees, &callers);
+	int result = EXIT_SUCCESS;
+	size_t *path = malloc((SymbolsCount + 1) * sizeof(size_t));
+	CHECK_ALLOC(path);
+
+	if (callersOf != NULL)
+	{
+		size_t fun = getFunctionIndex(elf, callersOf);
+		for (size_t i = callers.offsets[fun]; i < callers.offsets[fun + 1]; i++)
+			puts(Symbols[callers.edges[i]].name);
+	}
+	else if (chainsOf != NULL)
+	{
+		// chains end on the first function that exists in the pristine object
+		int pristineFd;
+		Elf *pristineElf = openElf(pristineFile, &pristineFd);
+		ChainWalk walk = { .path = path };
+		bool *stop = calloc(SymbolsCount + 1, sizeof(bool));
+		CHECK_ALLOC(stop);
+		walk.state = calloc(SymbolsCount + 1, sizeof(uint8_t));
+		CHECK_ALLOC(walk.state);
+		walk.next = calloc(SymbolsCount + 1, sizeof(size_t));
+		CHECK_ALLOC(walk.next);
+		walk.depth = calloc(SymbolsCount + 1, sizeof(size_t));
+		CHECK_ALLOC(walk.depth);
+		for (size_t i = 0; i < SymbolsCount; i++)
+		{
+			GElf_Sym sym;
+			if (Symbols[i].isFun &&
+				getSymbolByNameAndType(pristineElf, Symbols[i].name, STT_FUNC, &sym) &&
+				sym.st_shndx != SHN_UNDEF)
+				stop[i] = true;
+		}
+		walk.stop = stop;
+		size_t cycle = SIZE_MAX;
+		walkCallerChains(&callers, getFunctionIndex(elf, chainsOf), 0, &walk, &cycle);
+		free(walk.depth);
+		free(walk.next);
+		free(walk.state);
+		free(stop);
+		closeElf(pristineElf, pristineFd);
+	}
+	else if (pathFrom != NULL)
+	{
+		if (!printCallPath(&callees, getFunctionIndex(elf, pathFrom), getFunctionIndex(elf, pathTo)))
+			result = EXIT_FAILURE;
+	}
+	else
+	{
+		bool *visited = malloc(SymbolsCount * sizeof(bool));
+		CHECK_ALLOC(visited);
+		for (size_t i = 0; i < SymbolsCount; i++)
+		{
+			if (Symbols[i].isFun)
+			{
+				memset(visited, 0, SymbolsCount * sizeof(bool));
+				printCallees(&callees, i, path, 0, visited);
+			}
+		}
+		free(visited);
+	}
+
+	free(path);
+	freeCallGraph(&callees);
+	freeCallGraph(&callers);
+	freeSymbols();
+	closeElf(elf, fd);
+	free(filePath);
+	free(callersOf);
+	free(chainsOf);
+	free(pristineFile);
+	free(pathFrom);
+	free(pathTo);
+	return result;
+}
+
+static int extractSymbols(int argc, char *argv[])
+{
+	char *filePath = NULL;
+	char *outFile = NULL;
+	char **symToCopy = calloc(argc, sizeof(char *));
+	CHECK_ALLOC(symToCopy);
+	char **skipSymToCopy = calloc(argc, sizeof(char *));
+	CHECK_ALLOC(skipSymToCopy);
+	char **syms;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:o:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			filePath = strdup(optarg);
+			break;
+		case 'o':
+			outFile = strdup(optarg);
+			break;
+		case 's':
+			syms = symToCopy;
+			while (*syms != NULL)
+			{
+				if (strcmp(*syms, optarg) == 0)
+					break;
+				syms++;
+			}
+			if (*syms == NULL)
+				*syms = strdup(optarg);
+			break;
+		}
+	}
+
+	if (filePath == NULL || outFile == NULL || *symToCopy == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to extract symbols. Valid parameters:"
+			  "-f <ELF_FILE> -o <OUT_FILE> -s <SYMBOL_NAME> [-n <SKIP_DEP_SYMBOL>] [-V]");
+
+	int fd;
+	Elf *pelf = openElf(filePath, &fd);
+
+	elf_getshdrnum(pelf, &SectionsCount);
+	CopiedScnMap = calloc(SectionsCount, sizeof(Elf_Scn *));
+	CHECK_ALLOC(CopiedScnMap);
+
+	readSymbols(pelf);
+	dropCachedElf(outFile);
+	Elf *outElf = createNewElf(outFile);
+	copySymbols(pelf, outElf, symToCopy);
+
+	freeSymbols();
+	free(CopiedScnMap);
+
+	closeElf(pelf, fd);
+	free(filePath);
+	free(outFile);
+	return EXIT_SUCCESS;
+}
+
+static int changeCallSymbol(int argc, char *argv[])
+{
+	char *filePath = NULL;
+	char **symToCopy = calloc(argc, sizeof(char *));
+	CHECK_ALLOC(symToCopy);
+	int opt;
+	char *fromRelSym = NULL;
+	char *toRelSym = NULL;
+	size_t replaced = 0;
+
+	while ((opt = getopt(argc, argv, "s:d:vh")) != -1)
+	{
+		switch (opt)
+		{
+		case 's':
+			fromRelSym = strdup(optarg);
+			CHECK_ALLOC(fromRelSym);
+			break;
+		case 'd':
+			toRelSym = strdup(optarg);
+			CHECK_ALLOC(toRelSym);
+			break;
+		case 'v':
+			ShowDebugLog = 0;
+			break;
+		case '?':
+		case 'h':
+			help(argv[0]);
+			break;
+		case ':':
+			LOG_ERR("Missing arg for %c", optopt);
+			break;
+		}
+	}
+
+	if (optind - 1 < argc)
+	{
+		filePath = argv[optind++];
+		while (optind < argc)
+			LOG_ERR("Unknown parameter: %s", argv[optind++]);
+	}
+
+	if (filePath == NULL || fromRelSym == NULL || toRelSym== NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to change calling function. Valid parameters:"
+			  "-s <SYMBOL_NAME_SOURCE> -d <SYMBOL_NAME_DEST> [-v] <MODULE.ko>");
+
+	// the file is modified in place, so a cached copy would be outdated
+	dropCachedElf(filePath);
+	int fd = open(filePath, O_RDWR);
+	if (fd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open input file '%s'", filePath);
+
+	Elf *elf = elf_begin(fd, ELF_C_RDWR, NULL);
+	if (elf == NULL)
+		error(EXIT_FAILURE, errno, "Problems opening '%s' as ELF file: %s",
+			  filePath, elf_errmsg(-1));
+
+	size_t shstrndx;
+	if (elf_getshdrstrndx(elf, &shstrndx))
+		error(EXIT_FAILURE, errno, "Cannot get section header string index");
+
+	Elf_Scn *scn = NULL;
+	GElf_Shdr shdr;
+	GElf_Rela rela;
+	Elf_Data *data;
+
+	size_t oldSymIndex = getSymbolIndexByName(elf, fromRelSym);
+	size_t newSymIndex = getSymbolIndexByName(elf, toRelSym);
+	if (oldSymIndex == 0)
+		LOG_ERR("Can't find symbol '%s'\n", fromRelSym);
+	if (newSymIndex == 0)
+		LOG_ERR("Can't find symbol '%s'\n", toRelSym);
+
+	while ((scn = elf_nextscn(elf, scn)) != NULL)
+	{
+		gelf_getshdr(scn, &shdr);
+		if (shdr.sh_type != SHT_RELA)
+			continue;
+		data = elf_getdata(scn, NULL);
+		Elf64_Xword cnt = shdr.sh_size / shdr.sh_entsize;
+		for (Elf64_Xword i = 0; i < cnt; i++)
+		{
+			gelf_getrela(data, i, &rela);
+			if (ELF64_R_SYM(rela.r_info) == oldSymIndex)
+			{
+				rela.r_info = ELF64_R_INFO(newSymIndex, ELF64_R_TYPE(rela.r_info));
+				gelf_update_rela(data, i, &rela);
+				replaced++;
+			}
+		}
+	}
+
+	if (replaced && elf_update(elf, ELF_C_WRITE) == -1)
+		error(EXIT_FAILURE, errno, "elf_update failed: %s", elf_errmsg(-1));
+
+	closeElf(elf, fd);
+	free(fromRelSym);
+	free(toRelSym);
+
+	if (replaced == 0)
+		LOG_ERR("No relocation has been replaced");
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Retarget relocations of all sections in one pass. Relocations to symbol "i"
+ * are changed to "targets[i]" unless it's 0. Number of changed relocations of
+ * each symbol is written to "replaced".
+ */
+static void retargetRelocations(Elf *elf, const size_t *targets, size_t *replaced)
 {
+	size_t symCount = getElfIndex(elf)->symCount;
 	Elf_Scn *scn = NULL;
 	GElf_Shdr shdr;
-	size_t shstrndx;
-	elf_getshdrstrndx(elf, &shstrndx);
+	GElf_Rela rela;
 	while ((scn = elf_nextscn(elf, scn)) != NULL)
 	{
 		gelf_getshdr(scn, &shdr);
-		if (shdr.sh_type != SHT_RELA)
+		if (shdr.sh_type != SHT_RELA || shdr.sh_entsize == 0)
 			continue;
-
-		GElf_Rela rela;
 		Elf_Data *data = elf_getdata(scn, NULL);
 		size_t cnt = shdr.sh_size / shdr.sh_entsize;
 		for (size_t i = 0; i < cnt; i++)
 		{
 			gelf_getrela(data, i, &rela);
-			if (ELF64_R_SYM(rela.r_info) == left)
-			{
-				rela.r_info = ELF64_R_INFO(right, ELF64_R_TYPE(rela.r_info));
-				gelf_update_rela(data, i, &rela);
-			}
-			else if (ELF64_R_SYM(rela.r_info) == right)
-			{
-				rela.r_info = ELF64_R_INFO(left, ELF64_R_TYPE(rela.r_info));
-				gelf_update_rela(data, i, &rela);
-			}
+			size_t sym = ELF64_R_SYM(rela.r_info);
+			if (sym >= symCount || targets[sym] == 0)
+				continue;
+			rela.r_info = ELF64_R_INFO(targets[sym], ELF64_R_TYPE(rela.r_info));
+			gelf_update_rela(data, i, &rela);
+			replaced[sym]++;
 		}
 	}
 }
 
-static void sortSymtab(Elf *elf)
+/*
+ * Remove symbols marked in "remove" from the symbol table and update indexes
+ * of symbols in relocations and section groups. Removed symbols can't be used
+ * by any relocation.
+ */
+static void removeSymbols(Elf *elf, const bool *remove)
 {
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
-	GElf_Shdr shdr;
-	GElf_Sym sym;
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	int firstGlobalIndex = 0;
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	ElfIndex *index = getElfIndex(elf);
+	Elf_Scn *symtabScn = index->symtabScn;
+	size_t symtabIndex = elf_ndxscn(symtabScn);
+	GElf_Shdr symtabShdr;
+	gelf_getshdr(symtabScn, &symtabShdr);
+
+	size_t *newIndex = calloc(index->symCount, sizeof(size_t));
+	CHECK_ALLOC(newIndex);
+	size_t count = 0;
+	size_t firstGlobal = symtabShdr.sh_info;
+	for (size_t i = 0; i < index->symCount; i++)
 	{
-		gelf_getsym(data, i, &sym);
-		if (firstGlobalIndex == 0 && ELF64_ST_BIND(sym.st_info) == STB_GLOBAL)
-			firstGlobalIndex = i;
-
-		if (firstGlobalIndex != 0 && ELF64_ST_BIND(sym.st_info) == STB_LOCAL)
+		if (remove[i])
 		{
-			GElf_Sym globalSym;
-			gelf_getsym(data, firstGlobalIndex, &globalSym);
-			gelf_update_sym(data, i, &globalSym);
-			gelf_update_sym(data, firstGlobalIndex, &sym);
-			swapSymbolIndex(elf, i, firstGlobalIndex);
-			firstGlobalIndex = 0;
-			i = 0;
+			if (i < symtabShdr.sh_info)
+				firstGlobal--;
+			continue;
 		}
+		newIndex[i] = count++;
 	}
-	// update section info
-	shdr.sh_info = firstGlobalIndex;
-	gelf_update_shdr(scn, &shdr);
-}
-
-static Elf64_Word appendStringToScn(Elf *elf, char *scnName, char *text)
-{
-	GElf_Shdr shdr;
-	Elf_Scn *scn = getSectionByName(elf, scnName);
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	Elf64_Word result = appendString(&shdr, data, text);
-	gelf_update_shdr(scn, &shdr);
-	return result;
-}
 
-static size_t copySymbol(Elf *elf, Elf *outElf, size_t index, bool copySec)
-{
-	GElf_Sym oldSym;
+	// the same index is used in the extended section index table
+	Elf_Scn *scn = NULL;
 	GElf_Shdr shdr;
-	Elf_Scn *scn;
-	Elf_Data *data;
-	GElf_Sym newSym;
-
-	if (Symbols[index]->copiedIndex)
-		return Symbols[index]->copiedIndex;
-
-	scn = getSectionByName(elf, ".symtab");
-	data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	gelf_getsym(data, index, &oldSym);
-	scn = getSectionByName(outElf, ".symtab");
-	gelf_getshdr(scn, &shdr);
-	size_t newIndex = shdr.sh_size/shdr.sh_entsize;
-	data = elf_getdata(scn, NULL);
-	data->d_buf = realloc(data->d_buf, data->d_size + sizeof(GElf_Sym));
-	CHECK_ALLOC(data->d_buf);
-	newSym = oldSym;
-
-	char symType = ELF64_ST_TYPE(oldSym.st_info);
-	if (oldSym.st_shndx > 0 && oldSym.st_shndx < SectionsCount &&
-		copySec)
+	while ((scn = elf_nextscn(elf, scn)) != NULL)
 	{
-		Elf_Scn *scn = copySection(elf, outElf, oldSym.st_shndx, true);
-		newSym.st_shndx = elf_ndxscn(scn);
-
-		if (oldSym.st_name != 0)
+		gelf_getshdr(scn, &shdr);
+		if (shdr.sh_link != symtabIndex)
+			continue;
+		Elf_Data *data = elf_getdata(scn, NULL);
+		if (shdr.sh_type == SHT_RELA && shdr.sh_entsize != 0)
 		{
-			newSym.st_info = ELF64_ST_INFO(STB_GLOBAL, symType);
-			// TODO: Avoid modify symbol name for functions
-			if (symType == STT_FUNC)
-			{
-				char *symName = strdup(Symbols[index]->name);
-				CHECK_ALLOC(symName);
-				char *n;
-				while ((n = strchr(symName, '.')) != NULL)
-					*n = '_';
-				newSym.st_name = appendStringToScn(outElf, ".strtab", symName);
-
-				free(symName);
-			}
-			else
+			GElf_Rela rela;
+			size_t cnt = shdr.sh_size / shdr.sh_entsize;
+			for (size_t i = 0; i < cnt; i++)
 			{
-				newSym.st_name = appendStringToScn(outElf, ".strtab", Symbols[index]->name);
+				gelf_getrela(data, i, &rela);
+				size_t sym = ELF64_R_SYM(rela.r_info);
+				if (sym >= index->symCount)
+					LOG_ERR("Invalid symbol index: %ld in relocations for section %ld",
+							sym, elf_ndxscn(scn));
+				if (remove[sym])
+					LOG_ERR("Can't remove symbol '%s' that is used by a relocation",
+							index->symbols.names[sym]);
+				rela.r_info = ELF64_R_INFO(newIndex[sym], ELF64_R_TYPE(rela.r_info));
+				gelf_update_rela(data, i, &rela);
 			}
 		}
-	}
-	else // mark symbol as "external"
-	{
-		if (symType == STT_OBJECT && oldSym.st_name != 0)
+		else if (shdr.sh_type == SHT_GROUP)
 		{
-			if (strstr(getSectionName(elf, oldSym.st_shndx), ".read_mostly"))
+			if (shdr.sh_info >= index->symCount)
+				LOG_ERR("Invalid signature symbol index: %d of group section %ld",
+						shdr.sh_info, elf_ndxscn(scn));
+			shdr.sh_info = newIndex[shdr.sh_info];
+			gelf_update_shdr(scn, &shdr);
+		}
+		else if (shdr.sh_type == SHT_SYMTAB_SHNDX)
+		{
+			Elf32_Word *shndx = data->d_buf;
+			for (size_t i = 0; i < index->symCount; i++)
 			{
-				fprintf(stderr, "ERROR (%s:%d): Changes to the source code " \
-						"affects the %s variable marked with the " \
-						"__read_mostly macro. This is not yet supported by " \
-						"DEKU.\n", __FILE__, __LINE__, Symbols[index]->name);
-				exit(ERROR_UNSUPPORTED_READ_MOSTLY);
+				if (!remove[i])
+					shndx[newIndex[i]] = shndx[i];
 			}
+			data->d_size = count * sizeof(Elf32_Word);
+			elf_flagdata(data, ELF_C_SET, ELF_F_DIRTY);
+			shdr.sh_size = data->d_size;
+			gelf_update_shdr(scn, &shdr);
 		}
-		if (oldSym.st_shndx > 0 && oldSym.st_shndx < SectionsCount)
-			newSym.st_shndx = 0;
-		newSym.st_size = 0;
-		newSym.st_info = ELF64_ST_INFO(STB_GLOBAL, symType);
-		if (oldSym.st_name != 0)
-			newSym.st_name = copyStrtabItem(elf, outElf, oldSym.st_name);
 	}
 
-	memcpy((uint8_t *)data->d_buf + data->d_size, &newSym, sizeof(GElf_Sym));
-	data->d_size += sizeof(GElf_Sym);
-	shdr.sh_size = data->d_size;
-	gelf_update_shdr(scn, &shdr);
-
-	Symbols[index]->copiedIndex = newIndex;
-	return newIndex;
-}
-
-static void copyRelSection(Elf *elf, Elf *outElf, Elf64_Section index, size_t relTo, GElf_Sym *fromSym)
-{
-	Elf_Scn *outScn = copySection(elf, outElf, index, false);
-	GElf_Shdr shdr;
-	gelf_getshdr(outScn, &shdr);
-	shdr.sh_link = elf_ndxscn(getSectionByName(outElf, ".symtab"));
-	shdr.sh_info = relTo;
-	gelf_update_shdr(outScn, &shdr);
-
-	GElf_Rela rela;
-	size_t j = shdr.sh_size / shdr.sh_entsize;
-	Elf_Scn *scn = elf_getscn(elf, index);
-	Elf_Data *data = elf_getdata(scn, NULL);
-	Elf_Data *outData = elf_getdata(outScn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	outData->d_size += shdr.sh_size;
-	outData->d_buf = realloc(outData->d_buf, outData->d_size);
-	CHECK_ALLOC(outData->d_buf);
-	for (size_t i = 0; i < cnt; i++)
+	GElf_Sym sym;
+	for (size_t i = 0; i < index->symCount; i++)
 	{
-		gelf_getrela(data, i, &rela);
-		if (fromSym != NULL &&
-			(rela.r_offset < fromSym->st_value || rela.r_offset > fromSym->st_value + fromSym->st_size))
+		if (remove[i] || newIndex[i] == i)
 			continue;
-		size_t newSymIndex;
-		size_t symIndex = ELF64_R_SYM(rela.r_info);
-		GElf_Shdr shdr = getSectionHeader(elf, Symbols[symIndex]->secIndex);
-		const char *secName = getSectionName(elf, Symbols[symIndex]->secIndex);
-		if (shdr.sh_flags & SHF_STRINGS ||
-			strstr(secName, ".rodata.__func__") == secName)
-		{
-			newSymIndex = copySymbol(elf, outElf, symIndex, true);
-		}
-		else
-		{
-			Symbol *sym = fromSym == NULL ? Symbols[symIndex] : getSymbolForRelocation(rela);
-			bool isFuncOrVar = Symbols[sym->index]->isFun || Symbols[sym->index]->isVar;
-			bool copySec = fromSym == NULL ? true : !isFuncOrVar;
-			newSymIndex = copySymbol(elf, outElf, sym->index, copySec);
-		}
-		rela.r_info = ELF64_R_INFO(newSymIndex, ELF64_R_TYPE(rela.r_info));
-		gelf_update_rela(outData, j, &rela);
-		j++;
+		gelf_getsym(index->symData, i, &sym);
+		gelf_update_sym(index->symData, newIndex[i], &sym);
 	}
-	gelf_getshdr(outScn, &shdr);
-	shdr.sh_size = j * shdr.sh_entsize;
-	outData->d_size = shdr.sh_size;
-	if (!gelf_update_shdr(outScn, &shdr))
-		LOG_ERR("gelf_update_shdr failed");
+	index->symData->d_size = count * symtabShdr.sh_entsize;
+	elf_flagdata(index->symData, ELF_C_SET, ELF_F_DIRTY);
+	symtabShdr.sh_size = index->symData->d_size;
+	symtabShdr.sh_info = firstGlobal;
+	gelf_update_shdr(symtabScn, &symtabShdr);
+	free(newIndex);
 }
 
-static void copySectionWithRel(Elf *elf, Elf *outElf, Elf64_Section index, GElf_Sym *fromSym)
+// add section with the content of the file, the section name is appended to .shstrtab
+static void addFileSection(Elf *elf, const char *name, Elf64_Word type, Elf64_Xword flags,
+						   const char *filePath, char **buffers)
 {
-	Elf_Scn *newScn = copySection(elf, outElf, index, true);
-	Elf_Scn *relScn = getRelForSectionIndex(elf, index);
-	if (relScn)
-		copyRelSection(elf, outElf, elf_ndxscn(relScn), elf_ndxscn(newScn), fromSym);
-}
+	FILE *f = fopen(filePath, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buffers[0] = malloc(size + 1);
+	CHECK_ALLOC(buffers[0]);
+	if (fread(buffers[0], 1, size, f) != (size_t)size)
+		error(EXIT_FAILURE, errno, "Cannot read file '%s'", filePath);
+	fclose(f);
 
-static void copySymbols(Elf *elf, Elf *outElf, char **symbols)
-{
-	Elf_Scn *scn;
+	size_t shstrndx;
+	elf_getshdrstrndx(elf, &shstrndx);
+	Elf_Scn *strScn = elf_getscn(elf, shstrndx);
+	Elf_Data *strData = elf_getdata(strScn, NULL);
+	GElf_Shdr strShdr;
+	gelf_getshdr(strScn, &strShdr);
+	size_t nameOffset = strData->d_size;
+	buffers[1] = malloc(strData->d_size + strlen(name) + 1);
+	CHECK_ALLOC(buffers[1]);
+	memcpy(buffers[1], strData->d_buf, strData->d_size);
+	strcpy(buffers[1] + nameOffset, name);
+	strData->d_buf = buffers[1];
+	strData->d_size += strlen(name) + 1;
+	elf_flagdata(strData, ELF_C_SET, ELF_F_DIRTY);
+	strShdr.sh_size = strData->d_size;
+	gelf_update_shdr(strScn, &strShdr);
+
+	Elf_Scn *scn = elf_newscn(elf);
+	Elf_Data *data = elf_newdata(scn);
+	data->d_buf = buffers[0];
+	data->d_size = size;
+	data->d_type = ELF_T_BYTE;
+	data->d_align = 1;
 	GElf_Shdr shdr;
-	GElf_Sym sym;
-	size_t symIndex;
-	char **syms = symbols;
-	bool *symToCopy = calloc(sizeof(bool), SymbolsCount);
-	CHECK_ALLOC(symToCopy);
+	gelf_getshdr(scn, &shdr);
+	shdr.sh_name = nameOffset;
+	shdr.sh_type = type;
+	shdr.sh_flags = flags;
+	shdr.sh_size = size;
+	shdr.sh_addralign = 1;
+	gelf_update_shdr(scn, &shdr);
+}
 
-	while(*syms != NULL)
+/*
+ * Finalize the DEKU module in one write. Relocations to "<PREFIX><SYMBOL>"
+ * are changed to "<SYMBOL>", the prefixed symbols are removed and the note
+ * section is added.
+ */
+static int finalizeModule(int argc, char *argv[])
+{
+	char *prefix = NULL;
+	char *noteFile = NULL;
+	char **symbols = calloc(argc, sizeof(char *));
+	CHECK_ALLOC(symbols);
+	size_t symbolsCount = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "p:s:n:V")) != -1)
 	{
-		sym = getSymbolByName(elf, *syms, &symIndex);
-		if (sym.st_name == 0)
-			LOG_ERR("Can't find symbol: %s", *syms);
-		symToCopy[symIndex] = true;
-		syms++;
+		switch (opt)
+		{
+		case 'p':
+			prefix = strdup(optarg);
+			break;
+		case 's':
+			symbols[symbolsCount++] = strdup(optarg);
+			break;
+		case 'n':
+			noteFile = strdup(optarg);
+			break;
+		}
 	}
 
-	for (size_t i = 0; i < SymbolsCount; i++)
-	{
-		if (!symToCopy[i])
-			continue;
+	if (prefix == NULL || optind + 1 != argc)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to finalize module. Valid parameters:"
+			  "-p <PREFIX> [-s <SYMBOL>]... [-n <NOTE_FILE>] <MODULE.ko>");
+	const char *filePath = argv[optind];
 
-		sym = getSymbolByIndex(elf, i);
-		Elf_Scn *newScn = copySection(elf, outElf, sym.st_shndx, true);
-		size_t index = copySymbol(elf, outElf, i, true);
-		Elf_Scn *symScn = getSectionByName(outElf, ".symtab");
-		gelf_getshdr(symScn, &shdr);
-		Elf_Data *symData = elf_getdata(symScn, NULL);
-		gelf_getsym(symData, index, &sym);
-		sym.st_shndx = elf_ndxscn(newScn);
-		gelf_update_sym(symData, index, &sym);
-	}
+	// the file is modified in place, so a cached copy would be outdated
+	dropCachedElf(filePath);
+	int fd = open(filePath, O_RDWR);
+	if (fd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open input file '%s'", filePath);
 
-	for (size_t i = 0; i < SymbolsCount; i++)
-	{
-		if (!symToCopy[i])
-			continue;
+	Elf *elf = elf_begin(fd, ELF_C_RDWR, NULL);
+	if (elf == NULL)
+		error(EXIT_FAILURE, errno, "Problems opening '%s' as ELF file: %s",
+			  filePath, elf_errmsg(-1));
 
-		sym = getSymbolByIndex(elf, i);
-		copySectionWithRel(elf, outElf, sym.st_shndx, &sym);
+	ElfIndex *index = getElfIndex(elf);
+	bool *remove = calloc(index->symCount, sizeof(bool));
+	CHECK_ALLOC(remove);
+	size_t *targets = calloc(index->symCount, sizeof(size_t));
+	CHECK_ALLOC(targets);
+	size_t *replaced = calloc(index->symCount, sizeof(size_t));
+	CHECK_ALLOC(replaced);
+	size_t *fromIndexes = calloc(symbolsCount + 1, sizeof(size_t));
+	CHECK_ALLOC(fromIndexes);
+	for (size_t i = 0; i < symbolsCount; i++)
+	{
+		char *fromSym = malloc(strlen(prefix) + strlen(symbols[i]) + 1);
+		CHECK_ALLOC(fromSym);
+		sprintf(fromSym, "%s%s", prefix, symbols[i]);
+		size_t fromIndex = getSymbolIndexByName(elf, fromSym);
+		size_t toIndex = getSymbolIndexByName(elf, symbols[i]);
+		if (fromIndex == 0)
+			LOG_ERR("Can't find symbol '%s'", fromSym);
+		if (toIndex == 0)
+			LOG_ERR("Can't find symbol '%s'", symbols[i]);
+		targets[fromIndex] = toIndex;
+		fromIndexes[i] = fromIndex;
+		remove[fromIndex] = true;
+		free(fromSym);
 	}
-	const char *extraSections[] = {".altinstructions", ".altinstr_aux",
-								   ".altinstr_replacement",
-									/* needed for BUG() */ "__bug_table"
-								  };
-	for (size_t i = 0; i < sizeof(extraSections) / sizeof(*extraSections); i++)
+	if (symbolsCount > 0)
 	{
-		scn = getSectionByName(elf, extraSections[i]);
-		if (scn)
+		retargetRelocations(elf, targets, replaced);
+		for (size_t i = 0; i < symbolsCount; i++)
 		{
-			LOG_DEBUG("Copy %s section", extraSections[i]);
-			size_t index = elf_ndxscn(scn);
-			copySectionWithRel(elf, outElf, index, NULL);
+			if (replaced[fromIndexes[i]] == 0)
+				LOG_ERR("No relocation has been replaced for '%s%s'", prefix, symbols[i]);
 		}
+		removeSymbols(elf, remove);
 	}
-	checkStaticKeys(elf, symToCopy);
-
-	// TODO: Fix file path in string sections
 
-	sortSymtab(outElf);
+	char *buffers[2] = {0};
+	if (noteFile != NULL)
+		addFileSection(elf, ".note.deku", SHT_NOTE, SHF_ALLOC, noteFile, buffers);
 
-	elf_update(outElf, ELF_C_WRITE);
-	elf_end(outElf);
+	if (elf_update(elf, ELF_C_WRITE) == -1)
+		error(EXIT_FAILURE, errno, "elf_update failed: %s", elf_errmsg(-1));
 
-	free(symToCopy);
+	closeElf(elf, fd);
+	free(buffers[0]);
+	free(buffers[1]);
+	free(fromIndexes);
+	free(replaced);
+	free(targets);
+	free(remove);
+	for (size_t i = 0; i < symbolsCount; i++)
+		free(symbols[i]);
+	free(symbols);
+	free(prefix);
+	free(noteFile);
+	return EXIT_SUCCESS;
 }
 
-static Elf *openElf(const char *filePath, int *fd)
+static const char *fileBasename(const char *path)
 {
-	*fd = open(filePath, O_RDONLY);
-	if (*fd == -1)
-		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
-
-	Elf *elf = elf_begin(*fd, ELF_C_READ, NULL);
-	if (elf == NULL)
-		error(EXIT_FAILURE, errno, "Problems opening '%s' as ELF file: %s",
-			  filePath, elf_errmsg(-1));
-
-	size_t shstrndx;
-	if (elf_getshdrstrndx(elf, &shstrndx))
-		error(EXIT_FAILURE, errno, "Cannot get section header string index in %s", filePath);
-
-	if (getSectionByName(elf, ".strtab") == NULL)
-		LOG_ERR("Failed to find .strtab section");
-	if (getSectionByName(elf, ".symtab") == NULL)
-		LOG_ERR("Failed to find .symtab section");
-
-	return elf;
+	const char *name = strrchr(path, '/');
+	return name ? name + 1 : path;
 }
 
-static void symbolCallees(Elf *elf, Symbol *s, size_t *result)
+// index of the STT_FILE symbol that starts the group with the local symbol
+static size_t findFileSymbol(const ElfIndex *index, size_t symIndex)
 {
-	GElf_Shdr shdr;
-	GElf_Rela rela;
-	Elf_Scn *scn = getRelForSectionIndex(elf, s->secIndex);
-	gelf_getshdr(scn, &shdr);
-	Elf_Data *data = elf_getdata(scn, NULL);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	GElf_Sym sym;
+	for (size_t i = symIndex; i-- > 1;)
 	{
-		gelf_getrela(data, i, &rela);
-		size_t symIndex = ELF64_R_SYM(rela.r_info);
-		if (symIndex >= SymbolsCount)
-			LOG_ERR("Invalid symbol index: %ld in section relocation %ld", symIndex, elf_ndxscn(scn));
-		Symbol *sym = getSymbolForRelocation(rela);
-		if (sym->isFun)
-		{
-			size_t *r = result;
-			// add symIndex to result if result not contains it
-			while (*r != 0)
-			{
-				if (*r == sym->index)
-					break;
-				r++;
-			}
-			if (*r == 0)
-				*r = sym->index;
-		}
+		sym = index->syms[i];
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FILE)
+			return i;
 	}
+	return 0;
 }
 
-static void printCallees(Symbol *s, size_t *callStack, bool *visited)
+// number of symbols in the file group that also exist in the origin object
+static size_t scoreFileGroup(const ElfIndex *index, size_t fileIndex, const ElfIndex *origin)
 {
-	size_t *stack = callStack;
-	while(*stack-- != 0)
+	size_t score = 0;
+	GElf_Sym sym;
+	GElf_Shdr *shdr = &index->shdrs[elf_ndxscn(index->symtabScn)];
+	for (size_t i = fileIndex + 1; i < index->symCount && i < shdr->sh_info; i++)
 	{
-		if (*stack == s->index)
-			return;
+		sym = index->syms[i];
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FILE)
+			break;
+		if (ELF64_ST_TYPE(sym.st_info) == STT_SECTION || index->symbols.names[i][0] == '\0')
+			continue;
+		if (findInNameIndex(&origin->symbols, index->symbols.names[i], 0) != 0)
+			score++;
 	}
-	if (visited[s->index])
-		return;
-	visited[s->index] = true;
+	return score;
+}
 
-	*callStack = s->index;
-	size_t *calleeIdx = s->callees;
-	if (*calleeIdx == 0)
-	{
-		do
-		{
-			printf("%s ", Symbols[*callStack]->name);
-			callStack--;
-		} while(*callStack != 0);
-		puts("");
-		return;
-	}
-	while(*calleeIdx != 0)
+typedef struct
+{
+	size_t index;
+	Elf64_Addr value;
+} SymbolOccurrence;
+
+// check if the object defines or refers to the symbol with the global binding
+static bool isGlobalSymbol(const ElfIndex *index, const char *name)
+{
+	GElf_Sym sym;
+	for (size_t i = findInNameIndex(&index->symbols, name, 0); i != 0;
+		 i = findInNameIndex(&index->symbols, name, i))
 	{
-		printCallees(Symbols[*calleeIdx], callStack + 1, visited);
-		calleeIdx++;
+		sym = index->syms[i];
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FILE || ELF64_ST_TYPE(sym.st_info) == STT_SECTION)
+			continue;
+		if (ELF64_ST_BIND(sym.st_info) != STB_LOCAL)
+			return true;
 	}
+	return false;
 }
 
-static void help(const char *execName)
+static int compareOccurrences(const void *a, const void *b)
 {
-	error(EXIT_FAILURE, EINVAL, "Usage: %s [-diff|--callchain|--extract|--changeCallSymbol"
-#ifdef SUPPORT_DISASSEMBLE
-	"|--disassemble"
-#endif
-	"] ...", execName);
+	const SymbolOccurrence *x = a;
+	const SymbolOccurrence *y = b;
+	if (x->value != y->value)
+		return x->value < y->value ? -1 : 1;
+	return x->index < y->index ? -1 : x->index > y->index;
 }
 
-static void showDiff(int argc, char *argv[])
+/*
+ * Find position of the symbol among symbols with the same name in the kernel
+ * image, as expected by "sympos" in livepatch. Symbols are counted in the
+ * address order, the same as in kallsyms. The symbol from the source file is
+ * chosen by the STT_FILE symbol that starts the group of local symbols. If the
+ * file name is not unique, the group that shares most symbols with the origin
+ * object wins. If the symbol is global in the origin object, the global
+ * occurrence is chosen. Returns 0 if the symbol is unique and -1 if the
+ * position can't be found.
+ */
+static long findSymbolPosition(Elf *elf, Elf *originElf, const char *srcFile, const char *symName)
 {
-	char *firstFile;
-	char *secondFile;
-	int opt;
-	while ((opt = getopt(argc, argv, "a:b:")) != -1)
+	ElfIndex *index = getElfIndex(elf);
+	ElfIndex *origin = getElfIndex(originElf);
+	GElf_Shdr *shdr = &index->shdrs[elf_ndxscn(index->symtabScn)];
+	SymbolOccurrence *occurrences = NULL;
+	size_t count = 0;
+	GElf_Sym sym;
+	for (size_t i = findInNameIndex(&index->symbols, symName, 0); i != 0;
+		 i = findInNameIndex(&index->symbols, symName, i))
+	{
+		sym = index->syms[i];
+		if (ELF64_ST_TYPE(sym.st_info) == STT_FILE || ELF64_ST_TYPE(sym.st_info) == STT_SECTION)
+			continue;
+		occurrences = realloc(occurrences, (count + 1) * sizeof(SymbolOccurrence));
+		CHECK_ALLOC(occurrences);
+		occurrences[count++] = (SymbolOccurrence){ .index = i, .value = sym.st_value };
+	}
+
+	if (count <= 1)
+	{
+		free(occurrences);
+		return count == 1 ? 0 : -1;
+	}
+
+	LOG_DEBUG("Found %zu occurrences of the symbol '%s'", count, symName);
+	qsort(occurrences, count, sizeof(SymbolOccurrence), compareOccurrences);
+
+	if (isGlobalSymbol(origin, symName))
+	{
+		long pos = -1;
+		for (size_t i = 0; i < count && pos == -1; i++)
+		{
+			if (occurrences[i].index >= shdr->sh_info)
+				pos = i + 1;
+		}
+		free(occurrences);
+		return pos;
+	}
+
+	long pos = -1;
+	size_t bestScore = 0;
+	bool bestByName = false;
+	bool ambiguous = false;
+	for (size_t i = 0; i < count; i++)
 	{
-		switch (opt)
+		if (occurrences[i].index >= shdr->sh_info)
+			continue;
+		size_t fileIndex = findFileSymbol(index, occurrences[i].index);
+		if (fileIndex == 0)
+			continue;
+		bool byName = strcmp(fileBasename(index->symbols.names[fileIndex]),
+							 fileBasename(srcFile)) == 0;
+		if (bestByName && !byName)
+			continue;
+		size_t score = scoreFileGroup(index, fileIndex, origin);
+		if (byName && !bestByName)
 		{
-		case 'a':
-			firstFile = strdup(optarg);
-			break;
-		case 'b':
-			secondFile = strdup(optarg);
-			break;
+			bestByName = true;
+			bestScore = 0;
+			pos = -1;
+		}
+		if (score > bestScore || pos == -1)
+		{
+			ambiguous = false;
+			bestScore = score;
+			pos = i + 1;
+		}
+		else if (score == bestScore)
+		{
+			ambiguous = true;
 		}
 	}
+	free(occurrences);
 
-	if (firstFile == NULL || secondFile == NULL)
-		error(EXIT_FAILURE, EINVAL, "Invalid parameters to show difference between objects file. Valid parameters:"
-			  "-a <ELF_FILE> -b <ELF_FILE> [-V]");
-
-	int firstFd;
-	int secondFd;
-	Elf *firstElf = openElf(firstFile, &firstFd);
-	Elf *secondElf = openElf(secondFile, &secondFd);
-	findModifiedSymbols(secondElf, firstElf);
-	close(firstFd);
-	close(secondFd);
+	if (ambiguous || (!bestByName && bestScore == 0))
+		return -1;
+	return pos;
 }
 
-static void findCallChains(int argc, char *argv[])
+/*
+ * Find "sympos" for relocations in the format "<OBJECT>.<SYMBOL>". Prints
+ * "<OBJECT>.<SYMBOL>,<POSITION>" for each relocation, in the format expected
+ * by mklivepatch. Only symbols from the kernel image are resolved, the
+ * position of symbols from modules is always 0.
+ */
+static int findSymbolsPositions(int argc, char *argv[])
 {
 	char *filePath = NULL;
+	char *originPath = NULL;
+	char *srcFile = NULL;
 	int opt;
-	while ((opt = getopt(argc, argv, "f:")) != -1)
+	while ((opt = getopt(argc, argv, "f:o:s:V")) != -1)
 	{
 		switch (opt)
 		{
 		case 'f':
 			filePath = strdup(optarg);
 			break;
+		case 'o':
+			originPath = strdup(optarg);
+			break;
+		case 's':
+			srcFile = strdup(optarg);
+			break;
+		case 'V':
+			ShowDebugLog = true;
+			break;
 		}
 	}
 
-	if (filePath == NULL)
-		error(EXIT_FAILURE, EINVAL, "Invalid parameters to print call chain. Valid parameters:"
-			  "-f <ELF_FILE>");
+	if (filePath == NULL || originPath == NULL || srcFile == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to find symbols positions. Valid parameters:"
+			  "-f <VMLINUX> -o <ORIGIN_OBJECT> -s <SOURCE_FILE> [-V] <OBJECT.SYMBOL>...");
 
-	int fd;
-	Elf *elf = openElf(filePath, &fd);
-	Symbols = readSymbols(elf);
-	for (Symbol **s = Symbols; *s != NULL; s++)
+	Elf *elf = NULL;
+	Elf *originElf = NULL;
+	int fd = -1;
+	int originFd = -1;
+	int result = EXIT_SUCCESS;
+	for (int i = optind; i < argc; i++)
 	{
-		if (s[0]->isFun)
+		const char *rel = argv[i];
+		const char *symName = strchr(rel, '.');
+		if (symName == NULL || strncmp(rel, "vmlinux.", strlen("vmlinux.")) != 0)
+		{
+			printf("%s,0\n", rel);
+			continue;
+		}
+		symName++;
+
+		// the kernel image is opened only if needed
+		if (elf == NULL)
+		{
+			elf = openElf(filePath, &fd);
+			originElf = openElf(originPath, &originFd);
+		}
+
+		long pos = findSymbolPosition(elf, originElf, srcFile, symName);
+		if (pos == -1)
 		{
-			s[0]->callees = calloc(SymbolsCount, sizeof(size_t));
-			CHECK_ALLOC(s[0]->callees);
-			symbolCallees(elf, s[0], s[0]->callees);
+			fprintf(stderr, "Can't find index for symbol '%s'\n", symName);
+			result = EXIT_FAILURE;
+			continue;
 		}
+		printf("%s,%ld\n", rel, pos);
+	}
+
+	if (elf != NULL)
+	{
+		closeElf(originElf, originFd);
+		closeElf(elf, fd);
+	}
+	free(filePath);
+	free(originPath);
+	free(srcFile);
+	return result;
+}
+
+// index of the symbols exported by the kernel and modules
+typedef struct
+{
+	char *buf;
+	NameIndex symbols;
+} SymversIndex;
+
+// load Module.symvers, the symbol name is the second column
+static void loadSymvers(const char *filePath, SymversIndex *symvers)
+{
+	FILE *f = fopen(filePath, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", filePath);
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	symvers->buf = malloc(size + 1);
+	CHECK_ALLOC(symvers->buf);
+	if (fread(symvers->buf, 1, size, f) != (size_t)size)
+		error(EXIT_FAILURE, errno, "Cannot read file '%s'", filePath);
+	symvers->buf[size] = '\0';
+	fclose(f);
+
+	size_t linesCount = 1;
+	for (char *c = symvers->buf; *c != '\0'; c++)
+	{
+		if (*c == '\n')
+			linesCount++;
 	}
-	size_t *callStack = malloc(SymbolsCount * sizeof(size_t));
-	bool *visited = malloc(SymbolsCount * sizeof(bool));
-	CHECK_ALLOC(callStack);
-	for (Symbol **s = Symbols; *s != NULL; s++)
+	// entry at index 0 is not added to the index
+	const char **names = calloc(linesCount + 1, sizeof(char *));
+	CHECK_ALLOC(names);
+	size_t count = 1;
+	char *line = symvers->buf;
+	while (line != NULL && *line != '\0')
 	{
-		if (s[0]->isFun)
+		char *next = strchr(line, '\n');
+		if (next != NULL)
+			*next++ = '\0';
+		char *name = strchr(line, '\t');
+		if (name != NULL)
 		{
-			memset(callStack, 0, SymbolsCount * sizeof(size_t));
-			memset(visited, 0, SymbolsCount * sizeof(bool));
-			printCallees(s[0], callStack + 1, visited);
+			name++;
+			name[strcspn(name, "\t")] = '\0';
+			names[count++] = name;
 		}
+		line = next;
 	}
-	free(callStack);
-	free(visited);
-	close(fd);
+	buildNameIndex(&symvers->symbols, names, count);
+}
+
+static void freeSymvers(SymversIndex *symvers)
+{
+	freeNameIndex(&symvers->symbols);
+	free(symvers->buf);
+}
+
+static bool isLocalFunOrVar(const ElfIndex *index, const char *name)
+{
+	GElf_Sym sym;
+	for (size_t i = findInNameIndex(&index->symbols, name, 0); i != 0;
+		 i = findInNameIndex(&index->symbols, name, i))
+	{
+		sym = index->syms[i];
+		if (ELF64_ST_BIND(sym.st_info) == STB_LOCAL &&
+			(ELF64_ST_TYPE(sym.st_info) == STT_FUNC || ELF64_ST_TYPE(sym.st_info) == STT_OBJECT))
+			return true;
+	}
+	return false;
 }
 
-static void extractSymbols(int argc, char *argv[])
+/*
+ * Print undefined symbols of the module that need the livepatch relocation.
+ * Symbols exported by the kernel or modules are resolved by the module loader
+ * unless the symbol is local in the origin object. Symbols with the skipped
+ * prefix and ignored symbols are not printed.
+ */
+static int findSymbolsToRelocate(int argc, char *argv[])
 {
 	char *filePath = NULL;
-	char *outFile = NULL;
-	char **symToCopy = calloc(argc, sizeof(char *));
-	CHECK_ALLOC(symToCopy);
-	char **skipSymToCopy = calloc(argc, sizeof(char *));
-	CHECK_ALLOC(skipSymToCopy);
-	char **syms;
+	char *symversPath = NULL;
+	char *originPath = NULL;
+	char *skipPrefix = NULL;
+	char **ignoreSyms = calloc(argc, sizeof(char *));
+	CHECK_ALLOC(ignoreSyms);
+	size_t ignoreCount = 0;
 	int opt;
-	while ((opt = getopt(argc, argv, "f:o:s:")) != -1)
+	while ((opt = getopt(argc, argv, "f:s:o:i:p:V")) != -1)
 	{
 		switch (opt)
 		{
 		case 'f':
 			filePath = strdup(optarg);
 			break;
+		case 's':
+			symversPath = strdup(optarg);
+			break;
 		case 'o':
-			outFile = strdup(optarg);
+			originPath = strdup(optarg);
 			break;
-		case 's':
-			syms = symToCopy;
-			while (*syms != NULL)
-			{
-				if (strcmp(*syms, optarg) == 0)
-					break;
-				syms++;
-			}
-			if (*syms == NULL)
-				*syms = strdup(optarg);
+		case 'i':
+			ignoreSyms[ignoreCount++] = strdup(optarg);
+			break;
+		case 'p':
+			skipPrefix = strdup(optarg);
 			break;
 		}
 	}
 
-	if (filePath == NULL || outFile == NULL || *symToCopy == NULL)
-		error(EXIT_FAILURE, EINVAL, "Invalid parameters to extract symbols. Valid parameters:"
-			  "-f <ELF_FILE> -o <OUT_FILE> -s <SYMBOL_NAME> [-n <SKIP_DEP_SYMBOL>] [-V]");
-
-	int fd;
-	Elf *pelf = openElf(filePath, &fd);
+	if (filePath == NULL || symversPath == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to find symbols to relocate. Valid parameters:"
+			  "-f <MODULE.ko> -s <MODULE_SYMVERS> [-o <ORIGIN_OBJECT>] [-i <IGNORE_SYMBOL>] [-p <SKIP_PREFIX>]");
 
-	elf_getshdrnum(pelf, &SectionsCount);
-	CopiedScnMap = calloc(SectionsCount, sizeof(Elf_Scn *));
-	CHECK_ALLOC(CopiedScnMap);
+	SymversIndex symvers;
+	loadSymvers(symversPath, &symvers);
 
-	Elf *outElf = createNewElf(outFile);
-	Symbols = readSymbols(pelf);
-	copySymbols(pelf, outElf, symToCopy);
+	int fd;
+	int originFd = -1;
+	Elf *elf = openElf(filePath, &fd);
+	Elf *originElf = originPath ? openElf(originPath, &originFd) : NULL;
+	ElfIndex *index = getElfIndex(elf);
+	ElfIndex *origin = originElf ? getElfIndex(originElf) : NULL;
+	GElf_Sym sym;
+	for (size_t i = 1; i < index->symCount; i++)
+	{
+		const char *name = index->symbols.names[i];
+		sym = index->syms[i];
+		if (sym.st_shndx != SHN_UNDEF || name[0] == '\0')
+			continue;
+		if (skipPrefix != NULL && strncmp(name, skipPrefix, strlen(skipPrefix)) == 0)
+			continue;
 
-	for (Symbol **s = Symbols; *s != NULL; s++)
-		free(s[0]);
+		bool ignored = false;
+		for (size_t j = 0; j < ignoreCount && !ignored; j++)
+			ignored = strcmp(name, ignoreSyms[j]) == 0;
+		if (ignored)
+			continue;
 
-	free(Symbols);
-	free(CopiedScnMap);
+		if (findInNameIndex(&symvers.symbols, name, 0) != 0 &&
+			(origin == NULL || !isLocalFunOrVar(origin, name)))
+			continue;
+		puts(name);
+	}
 
-	close(fd);
+	if (originElf != NULL)
+		closeElf(originElf, originFd);
+	closeElf(elf, fd);
+	freeSymvers(&symvers);
+	for (size_t i = 0; i < ignoreCount; i++)
+		free(ignoreSyms[i]);
+	free(ignoreSyms);
 	free(filePath);
+	free(symversPath);
+	free(originPath);
+	free(skipPrefix);
+	return EXIT_SUCCESS;
 }
 
-static void changeCallSymbol(int argc, char *argv[])
+/*
+ * Check if functions can be patched by livepatch, i.e. the ftrace call site
+ * exists in the function. Call sites are found by relocations to __fentry__
+ * or mcount inside the function or by entries of __mcount_loc and
+ * __patchable_function_entries. For each function prints
+ * "<FUNCTION> traceable", "<FUNCTION> notrace" or "<FUNCTION> missing" if
+ * there is no such function in the object.
+ */
+static int checkTraceable(int argc, char *argv[])
 {
 	char *filePath = NULL;
-	char **symToCopy = calloc(argc, sizeof(char *));
-	CHECK_ALLOC(symToCopy);
 	int opt;
-	char *fromRelSym = NULL;
-	char *toRelSym = NULL;
-	size_t replaced = 0;
-
-	while ((opt = getopt(argc, argv, "s:d:vh")) != -1)
+	while ((opt = getopt(argc, argv, "f:V")) != -1)
 	{
 		switch (opt)
 		{
-		case 's':
-			fromRelSym = strdup(optarg);
-			CHECK_ALLOC(fromRelSym);
-			break;
-		case 'd':
-			toRelSym = strdup(optarg);
-			CHECK_ALLOC(toRelSym);
-			break;
-		case 'v':
-			ShowDebugLog = 0;
-			break;
-		case '?':
-		case 'h':
-			help(argv[0]);
-			break;
-		case ':':
-			LOG_ERR("Missing arg for %c", optopt);
+		case 'f':
+			filePath = strdup(optarg);
 			break;
 		}
 	}
 
-	if (optind - 1 < argc)
-	{
-		filePath = argv[optind++];
-		while (optind < argc)
-			LOG_ERR("Unknown parameter: %s", argv[optind++]);
-	}
-
-	if (filePath == NULL || fromRelSym == NULL || toRelSym== NULL)
-		error(EXIT_FAILURE, EINVAL, "Invalid parameters to change calling function. Valid parameters:"
-			  "-s <SYMBOL_NAME_SOURCE> -d <SYMBOL_NAME_DEST> [-v] <MODULE.ko>");
-
-	int fd = open(filePath, O_RDWR);
-	if (fd == -1)
-		error(EXIT_FAILURE, errno, "Cannot open input file '%s'", filePath);
-
-	Elf *elf = elf_begin(fd, ELF_C_RDWR, NULL);
-	if (elf == NULL)
-		error(EXIT_FAILURE, errno, "Problems opening '%s' as ELF file: %s",
-			  filePath, elf_errmsg(-1));
-
-	size_t shstrndx;
-	if (elf_getshdrstrndx(elf, &shstrndx))
-		error(EXIT_FAILURE, errno, "Cannot get section header string index");
-
-	Elf_Scn *scn = NULL;
-	GElf_Shdr shdr;
-	GElf_Rela rela;
-	Elf_Data *data;
-
-	uint16_t oldSymIndex = getSymbolIndexByName(elf, fromRelSym);
-	uint16_t newSymIndex = getSymbolIndexByName(elf, toRelSym);
-	if (oldSymIndex == 0)
-		LOG_ERR("Can't find symbol '%s'\n", fromRelSym);
-	if (newSymIndex == 0)
-		LOG_ERR("Can't find symbol '%s'\n", toRelSym);
+	if (filePath == NULL || optind >= argc)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to check traceable functions. Valid parameters:"
+			  "-f <ELF_FILE> <FUNCTION>...");
 
-	while ((scn = elf_nextscn(elf, scn)) != NULL)
+	int fd;
+	Elf *elf = openElf(filePath, &fd);
+	size_t sitesCount;
+	CallSite *sites = findRecordedCallSites(elf, &sitesCount);
+	for (int i = optind; i < argc; i++)
 	{
-		gelf_getshdr(scn, &shdr);
-		if (shdr.sh_type != SHT_RELA)
-			continue;
-		data = elf_getdata(scn, NULL);
-		Elf64_Xword cnt = shdr.sh_size / shdr.sh_entsize;
-		for (Elf64_Xword i = 0; i < cnt; i++)
+		GElf_Sym sym;
+		if (!getSymbolByNameAndType(elf, argv[i], STT_FUNC, &sym))
 		{
-			gelf_getrela(data, i, &rela);
-			if (ELF64_R_SYM(rela.r_info) == oldSymIndex)
-			{
-				rela.r_info = ELF64_R_INFO(newSymIndex, ELF64_R_TYPE(rela.r_info));
-				gelf_update_rela(data, i, &rela);
-				replaced++;
-			}
+			printf("%s missing\n", argv[i]);
+			continue;
 		}
-	}
 
-	if (replaced && elf_update(elf, ELF_C_WRITE) == -1)
-		error(EXIT_FAILURE, errno, "elf_update failed: %s", elf_errmsg(-1));
-
-	close(fd);
-	free(fromRelSym);
-	free(toRelSym);
+		bool traceable = isTraceableSymbol(elf, &sym, sites, sitesCount);
+		printf("%s %s\n", argv[i], traceable ? "traceable" : "notrace");
+	}
 
-	if (replaced == 0)
-		LOG_ERR("No relocation has been replaced");
+	free(sites);
+	closeElf(elf, fd);
+	free(filePath);
+	return EXIT_SUCCESS;
 }
 
 #ifdef SUPPORT_DISASSEMBLE
-static void disassemble(int argc, char *argv[])
+static int disassemble(int argc, char *argv[])
 {
 	char *filePath = NULL;
 	char *symName = NULL;
@@ -1440,8 +4075,7 @@ static void disassemble(int argc, char *argv[])
 	if (!getSymbolByNameAndType(elf, symName, STT_FUNC, &sym))
 		LOG_ERR("Can't find symbol %s", symName);
 
-	GElf_Shdr shdr;
-	gelf_getshdr(getSectionByName(elf, ".symtab"), &shdr);
+	GElf_Shdr shdr = getSectionHeader(elf, elf_ndxscn(getElfIndex(elf)->symtabScn));
 	SymbolData symData = getSymbolData(elf, symName, STT_FUNC, true);
 	DisasmData data = { .elf = elf, .sym = sym, .shdr = shdr, .symData = &symData };
 
@@ -1451,16 +4085,23 @@ static void disassemble(int argc, char *argv[])
 	free(disassembled);
 	free(symName);
 	free(filePath);
-	close(fd);
+	closeElf(elf, fd);
+	return EXIT_SUCCESS;
 }
 #endif
 
-int main(int argc, char *argv[])
+static int runCommand(int argc, char *argv[])
 {
 	bool showDiffElf = false;
 	bool showCallChain = false;
 	bool extractSym = false;
 	bool changeCallSym = false;
+	bool benchmark = false;
+	bool sympos = false;
+	bool symsToRelocate = false;
+	bool traceable = false;
+	bool finalize = false;
+	bool fingerprint = false;
 #ifdef SUPPORT_DISASSEMBLE
 	bool disasm = false;
 #endif
@@ -1474,6 +4115,18 @@ int main(int argc, char *argv[])
 			extractSym = true;
 		if (strcmp(argv[i], "--changeCallSymbol") == 0)
 			changeCallSym = true;
+		if (strcmp(argv[i], "--benchmarkFingerprint") == 0)
+			benchmark = true;
+		if (strcmp(argv[i], "--sympos") == 0)
+			sympos = true;
+		if (strcmp(argv[i], "--symsToRelocate") == 0)
+			symsToRelocate = true;
+		if (strcmp(argv[i], "--traceable") == 0)
+			traceable = true;
+		if (strcmp(argv[i], "--finalize") == 0)
+			finalize = true;
+		if (strcmp(argv[i], "--fingerprint") == 0)
+			fingerprint = true;
 #ifdef SUPPORT_DISASSEMBLE
 		if (strcmp(argv[i], "--disassemble") == 0)
 			disasm = true;
@@ -1481,21 +4134,184 @@ int main(int argc, char *argv[])
 		if (strcmp(argv[i], "-V") == 0)
 			ShowDebugLog = true;
 	}
-	elf_version(EV_CURRENT);
 
 	if (showDiffElf)
-		showDiff(argc - 1, argv + 1);
+		return showDiff(argc - 1, argv + 1);
 	else if (showCallChain)
-		findCallChains(argc - 1, argv + 1);
+		return findCallChains(argc - 1, argv + 1);
 	else if (extractSym)
-		extractSymbols(argc - 1, argv + 1);
+		return extractSymbols(argc - 1, argv + 1);
 	else if (changeCallSym)
-		changeCallSymbol(argc - 1, argv + 1);
+		return changeCallSymbol(argc - 1, argv + 1);
+	else if (benchmark)
+		return benchmarkFingerprint(argc - 1, argv + 1);
+	else if (sympos)
+		return findSymbolsPositions(argc - 1, argv + 1);
+	else if (symsToRelocate)
+		return findSymbolsToRelocate(argc - 1, argv + 1);
+	else if (traceable)
+		return checkTraceable(argc - 1, argv + 1);
+	else if (finalize)
+		return finalizeModule(argc - 1, argv + 1);
+	else if (fingerprint)
+		return writeFingerprints(argc - 1, argv + 1);
 #ifdef SUPPORT_DISASSEMBLE
 	else if (disasm)
-		disassemble(argc - 1, argv + 1);
+		return disassemble(argc - 1, argv + 1);
 #endif
-	else
-		help(argv[0]);
-	return 0;
+	help(argv[0]);
+	return EXIT_FAILURE;
+}
+
+/*
+ * Split the command line into arguments. Arguments are separated by
+ * whitespaces and can be quoted with single or double quotes. Outside single
+ * quotes the backslash escapes the next character.
+ */
+static char **splitCommandLine(const char *execName, const char *line, int *argc)
+{
+	size_t len = strlen(line);
+	// every argument takes at least two bytes of the line
+	char **argv = calloc(len / 2 + 3, sizeof(char *));
+	CHECK_ALLOC(argv);
+	char *buf = malloc(len + 1);
+	CHECK_ALLOC(buf);
+	argv[0] = strdup(execName);
+	CHECK_ALLOC(argv[0]);
+	*argc = 1;
+
+	const char *c = line;
+	while (true)
+	{
+		while (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r')
+			c++;
+		if (*c == '\0' || *c == '#')
+			break;
+
+		size_t argLen = 0;
+		char quote = 0;
+		for (; *c != '\0'; c++)
+		{
+			if (quote == 0 && (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r'))
+				break;
+			if (*c == quote)
+				quote = 0;
+			else if (quote == 0 && (*c == '\'' || *c == '"'))
+				quote = *c;
+			else if (*c == '\\' && quote != '\'' && c[1] != '\0')
+				buf[argLen++] = *++c;
+			else
+				buf[argLen++] = *c;
+		}
+		if (quote != 0)
+			LOG_ERR("Unterminated quote in command: %s", line);
+
+		argv[*argc] = strndup(buf, argLen);
+		CHECK_ALLOC(argv[*argc]);
+		(*argc)++;
+	}
+
+	free(buf);
+	return argv;
+}
+
+// report the status of the command that ended the batch process
+static void onBatchExit(int status, void *arg)
+{
+	if (*(bool *)arg)
+	{
+		printf(BATCH_EXIT_MARKER " %d\n", status);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Run commands read line by line from the file or standard input. Opened ELF
+ * files are kept in the cache between commands, so each file is parsed once.
+ * The end of the output of each command is marked with the line
+ * "@end <EXIT_CODE>". A command that fails with an error ends the batch and its
+ * output is marked with "@exit <EXIT_CODE>".
+ */
+static int runBatch(const char *execName, int argc, char *argv[])
+{
+	static bool commandRunning = false;
+	char *cmdFile = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:V")) != -1)
+	{
+		switch (opt)
+		{
+		case 'i':
+			cmdFile = strdup(optarg);
+			break;
+		case 'V':
+			break;
+		default:
+			error(EXIT_FAILURE, EINVAL, "Invalid parameters to run batch. Valid parameters:"
+				  "[-i <CMD_FILE>] [-V]");
+		}
+	}
+
+	FILE *input = stdin;
+	if (cmdFile != NULL)
+	{
+		input = fopen(cmdFile, "r");
+		if (input == NULL)
+			error(EXIT_FAILURE, errno, "Cannot open file '%s'", cmdFile);
+	}
+
+	BatchMode = true;
+	on_exit(onBatchExit, &commandRunning);
+	const FingerprintEngine *defaultFingerprint = Fingerprint;
+	bool defaultShowDebugLog = ShowDebugLog;
+	int result = EXIT_SUCCESS;
+	char *line = NULL;
+	size_t lineSize = 0;
+	while (getline(&line, &lineSize, input) != -1)
+	{
+		int cmdArgc;
+		char **cmdArgv = splitCommandLine(execName, line, &cmdArgc);
+		if (cmdArgc > 1)
+		{
+			Fingerprint = defaultFingerprint;
+			ShowDebugLog = defaultShowDebugLog;
+			// reinitialize getopt for the new arguments
+			optind = 0;
+			commandRunning = true;
+			int status = runCommand(cmdArgc, cmdArgv);
+			commandRunning = false;
+			if (status != EXIT_SUCCESS)
+				result = status;
+			printf(BATCH_END_MARKER " %d\n", status);
+			fflush(stdout);
+		}
+		for (int i = 0; i < cmdArgc; i++)
+			free(cmdArgv[i]);
+		free(cmdArgv);
+	}
+
+	free(line);
+	if (input != stdin)
+		fclose(input);
+	free(cmdFile);
+	freeElfCache();
+	BatchMode = false;
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	elf_version(EV_CURRENT);
+	initFingerprint();
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-V") == 0)
+			ShowDebugLog = true;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+		return runBatch(argv[0], argc - 1, argv + 1);
+
+	return runCommand(argc, argv);
 }
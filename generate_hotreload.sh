@@ -36,22 +36,12 @@ getSymbolsToRelocate()
 	local ignoresymbols=(
 						"_printk"
 						)
-	local syms=()
-	local staticsymbols=(`readelf -W -s "$originobj" | \
-						  awk 'BEGIN { ORS=" " } {
-						  	if(($4 == "FUNC" || $4 == "OBJECT") && $5 == "LOCAL" ) {print $8}
-						  }'`)
-	local undsymbols=(`readelf -W -s "$module" | awk 'BEGIN { ORS=" " } { if($7 == "UND") {print $8} }'`)
-	local greparg=`printf -- " -e \\s%s\\s" "${undsymbols[@]}"`
-	local globalsymbols=`grep $greparg "$symvers" | tr '\n' ' '`
-	read -a globalsymbols <<< "$globalsymbols"
-	for sym in "${undsymbols[@]}"
+	local args=(-f "$module" -s "$symvers" -o "$originobj" -p "$DEKU_FUN_PREFIX")
+	for sym in "${ignoresymbols[@]}"
 	do
-		[[ "$sym" == $DEKU_FUN_PREFIX* ]] && continue
-		[[ " ${ignoresymbols[*]} " =~ " $sym " ]] && continue
-		[[ " ${globalsymbols[*]} " =~ " $sym " ]] && continue
-		echo "$sym"
+		args+=(-i "$sym")
 	done
+	./elfutils --symsToRelocate "${args[@]}"
 }
 
 relocations()
@@ -63,15 +53,24 @@ relocations()
 	local originobj="$BUILD_DIR/${srcfile%.*}.o"
 
 	local syms=$(getSymbolsToRelocate "$moduledir/$module.ko" "$originobj" "$LINUX_HEADERS/Module.symvers")
+	local -A objs counts
+	[[ "$syms" != "" ]] && findObjsWithSymbols objs counts $syms
 
 	while read -r sym;
 	do
+		[[ "$sym" == "" ]] && continue
 		grep -q "\b$sym\b" "$modsymfile" && continue
-		local objname=$(findObjWithSymbol "$sym" "$srcfile")
+		local objname=${objs[$sym]}
+		local cnt=${counts[$sym]}
+		if [[ "$objname" == "" ]]; then
+			objname=$(findObjWithSymbol "$sym" "$srcfile")
+			if [[ $objname != "vmlinux" ]]; then
+				local objpath=`find $SYMBOLS_DIR -type f -name "$objname"`
+				objpath=${objpath#*$SYMBOLS_DIR/}.ko
+				cnt=`nm "$BUILD_DIR/$objpath" | grep "\b$sym\b" | wc -l`
+			fi
+		fi
 		if [[ $objname != "vmlinux" ]]; then
-			local objpath=`find $SYMBOLS_DIR -type f -name "$objname"`
-			objpath=${objpath#*$SYMBOLS_DIR/}.ko
-			local cnt=`nm "$BUILD_DIR/$objpath" | grep "\b$sym\b" | wc -l`
 			if [[ $cnt > 1 ]]; then
 				logErr "A relocation is needed for the '$sym' function, which is located in the kernel module. This is not yet supported by DEKU."
 			fi
@@ -84,42 +83,6 @@ relocations()
 	done <<< "$syms"
 }
 
-findSymbolIndex()
-{
-	local -n index=$1
-	local rel=$2
-	local kofile=$3
-	local objname=${rel%%.*}
-	local symbol=${rel#*.}
-	index=0
-	[[ "$objname" != "vmlinux" ]] && return $NO_ERROR
-	local mapfile="$SYSTEM_MAP"
-	local count=`grep " $symbol$" "$mapfile" | wc -l`
-	[[ $count == "1" ]] && return
-	logInfo "Found $count occurrences of the symbol '$symbol'"
-	local maches=`grep -A 10 -B 10 " $symbol$" "$mapfile" | cut -d " " -f 3`
-	index=1
-	local occure=0
-	while read -r sym; do
-		[[ "$sym" == "--" ]] && { occure=0; ((index++)); continue; }
-		local found=`nm "$kofile" | grep "$sym"`
-		if [[ "$found" != "" ]]; then
-			((occure++))
-			[[ $occure == "10" ]] && return $NO_ERROR
-		fi
-	done <<< "$maches"
-	local filename=$(<`dirname $kofile`/$FILE_SRC_PATH)
-	filename=`basename $filename`
-	index=`readelf -a "$BUILD_DIR/vmlinux" | \
-		grep -e "\b$filename\b" -e "\b$symbol$" | \
-		grep -n $filename | \
-		head -1 | \
-		cut -f1 -d:`
-	[[ "$index" != "" ]] && return $NO_ERROR
-	logErr "Can't find index for symbol '$symbol'. This feature is not yet fully supported by DEKU"
-	exit $ERROR_CANT_FIND_SYM_INDEX
-}
-
 main()
 {
 	local modules
@@ -150,12 +113,19 @@ main()
 				args+=("-s $objname.$sym")
 			done < $modsymfile
 
+			local srcfile=$(<$moduledir/$FILE_SRC_PATH)
+			local positions
+			positions=$(./elfutils --sympos -f "$BUILD_DIR/vmlinux" \
+					   -o "$BUILD_DIR/${srcfile%.*}.o" -s "$srcfile" $relocs)
+			if [[ $? != 0 ]]; then
+				logErr "Finding the position of this symbol in the kernel is not yet fully supported by DEKU"
+				exit $ERROR_CANT_FIND_SYM_INDEX
+			fi
+
 			while read -r rel; do
-				local ndx=0
-				findSymbolIndex ndx "$rel" "$kofile"
-				args+=("-r $rel,$ndx")
+				args+=("-r $rel")
 				logDebug "Relocate \"$rel\""
-			done <<< "$relocs"
+			done <<< "$positions"
 
 			[[ "$LOG_LEVEL" > 0 ]] && args+=("-V")
 			args+=("$kofile")
@@ -6,6 +6,151 @@
 # Generate livepatch module by compare elf files and extract changed functions
 
 RUN_POST_BUILD=0
+ELFUTILS_BATCH_PID=
+ELFUTILS_BATCH_OWNER=
+JOBSERVER_READ=
+JOBSERVER_WRITE=
+MAKE_JOBS=
+JOBS_PIDS=()
+JOBS_LOGS=()
+JOBS_OWN_PID=
+
+# Use the make jobserver when run from make, otherwise run up to $JOBS jobs
+# with the jobserver of this process
+initJobs()
+{
+	local auth=`sed -n 's/.*--jobserver-\(auth\|fds\)=\([^ ]\+\).*/\2/p' <<< "$MAKEFLAGS"`
+	if [[ "$JOBS" == "" && "$auth" == "fifo:"* && -p "${auth#fifo:}" ]]; then
+		exec {JOBSERVER_READ}<>"${auth#fifo:}"
+		JOBSERVER_WRITE=$JOBSERVER_READ
+	elif [[ "$JOBS" == "" && "$auth" == *","* && \
+			-e /proc/$$/fd/${auth%,*} && -e /proc/$$/fd/${auth#*,} ]]; then
+		JOBSERVER_READ=${auth%,*}
+		JOBSERVER_WRITE=${auth#*,}
+	else
+		JOBS=${JOBS:-`nproc`}
+		local fifo=`mktemp -u`
+		mkfifo "$fifo" || exit 1
+		exec {JOBSERVER_READ}<>"$fifo"
+		rm -f "$fifo"
+		JOBSERVER_WRITE=$JOBSERVER_READ
+		# a token for every job but the one in the slot of this process
+		local tokens
+		printf -v tokens "%*s" $((JOBS - 1)) ""
+		echo -n "${tokens// /+}" >&$JOBSERVER_WRITE
+		# kbuild builds two objects at once
+		MAKE_JOBS="-j2"
+	fi
+}
+
+# Run the command as a background job as soon as there is a free job slot.
+# Output of the job is written to the log file.
+startJob()
+{
+	local log=$1
+	shift
+	local token=
+	# one job runs in the slot of this process, others need a token. Tokens
+	# and the slot are freed by finished jobs.
+	while [[ "$JOBS_OWN_PID" ]] && kill -0 $JOBS_OWN_PID 2>/dev/null && \
+		  ! takeJobToken token
+	do
+		wait -n
+	done
+
+	(
+		# give the token back also if the job calls exit
+		trap '[[ "$token" ]] && releaseJobToken "$token"' EXIT
+		"$@"
+	) > "$log" 2>&1 &
+	[[ "$token" ]] || JOBS_OWN_PID=$!
+	JOBS_PIDS+=($!)
+	JOBS_LOGS+=("$log")
+}
+
+# Take a token for an additional process of the running job if there is one
+# free. Waiting for it could block all jobs, each holding a single token.
+takeJobToken()
+{
+	local -n jobtoken=$1
+	read -r -N 1 -t 0.01 -u $JOBSERVER_READ jobtoken
+}
+
+releaseJobToken()
+{
+	echo -n "$1" >&$JOBSERVER_WRITE
+}
+
+# Wait for all jobs and print their logs in the order the jobs were started.
+# Returns the exit code of the first failed job.
+waitForJobs()
+{
+	local result=0
+	for i in "${!JOBS_PIDS[@]}"
+	do
+		wait ${JOBS_PIDS[$i]}
+		local rc=$?
+		if [[ $rc == 0 ]]; then
+			cat "${JOBS_LOGS[$i]}"
+		else
+			cat "${JOBS_LOGS[$i]}" >&2
+			[[ $result == 0 ]] && result=$rc
+		fi
+	done
+	JOBS_PIDS=()
+	JOBS_LOGS=()
+	JOBS_OWN_PID=
+	return $result
+}
+
+startElfutils()
+{
+	# hide bash warning about the coprocess inherited from the parent shell
+	{ coproc ELFUTILS_BATCH { ./elfutils --batch 2>&4; } } 4>&2 2>/dev/null
+	ELFUTILS_BATCH_OWNER=$BASHPID
+}
+
+stopElfutils()
+{
+	[[ "$ELFUTILS_BATCH_OWNER" != "$BASHPID" ]] && return
+	kill -0 "$ELFUTILS_BATCH_PID" 2>/dev/null || return
+	eval "exec ${ELFUTILS_BATCH[1]}>&-"
+	wait "$ELFUTILS_BATCH_PID" 2>/dev/null
+}
+
+# Run the elfutils command in the batch process that keeps parsed objects
+# between calls. Output of the command is stored in the variable given as the
+# first parameter. Returns the exit code of the command.
+runElfutils()
+{
+	local -n cmdout=$1
+	shift
+	cmdout=""
+	if [[ "$ELFUTILS_BATCH_OWNER" != "$BASHPID" ]] || \
+	   ! kill -0 "$ELFUTILS_BATCH_PID" 2>/dev/null; then
+		startElfutils
+	fi
+
+	local infd=${ELFUTILS_BATCH[1]}
+	local outfd=${ELFUTILS_BATCH[0]}
+	echo "$(printf "%q " "$@")" >&$infd
+	local line
+	while IFS= read -r line <&$outfd
+	do
+		if [[ "$line" == "@end "* ]]; then
+			return ${line#@end }
+		fi
+		if [[ "$line" == "@exit "* ]]; then
+			wait "$ELFUTILS_BATCH_PID" 2>/dev/null
+			ELFUTILS_BATCH_OWNER=
+			return ${line#@exit }
+		fi
+		cmdout+="$line"$'\n'
+	done
+	# batch process has ended without reporting the status
+	ELFUTILS_BATCH_OWNER=
+	return 1
+}
 
 getFileDiff()
 {
@@ -128,6 +273,21 @@ cmdBuildFile()
 	cmdarray=("${newcmd[*]}" "$extracmd")
 }
 
+# Get path of the cached origin object. The key is made from the origin source
+# and the command used to build it. Cache is cleared on sync.
+cachedOriginObject()
+{
+	local file=$1
+	local originsrc=$2
+
+	local cmds=()
+	cmdBuildFile "$file" cmds
+	[[ ${cmds[0]} == "" ]] && return 1
+	local key=`{ cat "$originsrc"; echo "${cmds[0]}"; echo "${cmds[1]}"; } | \
+			   md5sum | cut -d' ' -f1`
+	echo "$PRISTINE_CACHE_DIR/$key.o"
+}
+
 buildFile()
 {
 	local srcfile=$1
@@ -173,7 +333,7 @@ buildModules()
 	local moduledir=$1
 	# go to workdir instead of use "-C" because the "$(PWD)" is used in Makefile
 	cd $moduledir
-	out=`make $USE_LLVM 2>&1`
+	out=`make $USE_LLVM $MAKE_JOBS 2>&1`
 	rc=$?
 	cd $OLDPWD
 
@@ -217,67 +377,142 @@ buildLivepatchModule()
 	buildModules "$moduledir"
 }
 
-function isTraceable()
+# Prepare module directory and build the origin and the modified object file
+buildObjects()
 {
 	local file=$1
-	local symbol=$2
-
-	local val=`readelf -sW "$file" | \
-			   grep FUNC | \
-			   grep " $symbol$" | \
-			   cut -d':' -f 2 | \
-			   xargs | \
-			   cut -d' ' -f 1`
-	[[ $val == "" ]] && return 0
-	val="0x$val"
-	fentryoff=`printf "000000%x" $(($val + 1))`
-	fentry=`readelf -rW "$file" | grep __fentry__`
-	grep -q $fentryoff <<< $fentry && return 0 || return 1
+	local moduledir=$2
+	local basename=`basename $file`
+	local filename=$(filenameNoExt "$file")
+
+	# write diff to file for debug purpose
+	getFileDiff $file > "$moduledir/diff"
+
+	# file name with prefix '_' is the origin file
+	if [ "$KERN_SRC_INSTALL_DIR" ]; then
+		cp "$KERN_SRC_INSTALL_DIR/$file" "$moduledir/_$basename"
+	else
+		git -C $workdir cat-file blob ":$file" > "$moduledir/_$basename"
+	fi
+
+	cp "$SOURCE_DIR/$file" "$moduledir/$basename"
+	echo -n "$file" > "$moduledir/$FILE_SRC_PATH"
+
+	local cachedobj=$(cachedOriginObject "$file" "$moduledir/_$basename")
+	local originpid=
+	local originrc=
+	local token=
+	if [[ "$cachedobj" && -f "$cachedobj" ]]; then
+		logDebug "Use cached origin object for $file"
+		cp "$cachedobj" "$moduledir/_$filename.o"
+		[[ -f "${cachedobj%.o}.fp" ]] && cp "${cachedobj%.o}.fp" "$moduledir/_$filename.fp"
+	elif takeJobToken token; then
+		# build both files at once
+		(
+			trap 'releaseJobToken "$token"' EXIT
+			buildFile $file "$moduledir/_$basename" "$moduledir/_$filename.o"
+		) &
+		originpid=$!
+	else
+		buildFile $file "$moduledir/_$basename" "$moduledir/_$filename.o"
+		originrc=$?
+	fi
+	buildFile $file "$moduledir/$basename" "$moduledir/$filename.o"
+	local usekbuild=$?
+	if [[ "$originpid" ]]; then
+		wait $originpid
+		originrc=$?
+	fi
+	if [[ "$originrc" ]]; then
+		if [[ $originrc == 0 ]]; then
+			if [[ "$cachedobj" ]]; then
+				mkdir -p "$PRISTINE_CACHE_DIR"
+				cp "$moduledir/_$filename.o" "$cachedobj.$BASHPID" && \
+				mv -f "$cachedobj.$BASHPID" "$cachedobj"
+				# fingerprints of the origin object are used by --diff in place of the object
+				local fpout
+				local cachedfp="${cachedobj%.o}.fp"
+				runElfutils fpout --fingerprint -f "$moduledir/_$filename.o" \
+							-o "$moduledir/_$filename.fp" && \
+				cp "$moduledir/_$filename.fp" "$cachedfp.$BASHPID" && \
+				mv -f "$cachedfp.$BASHPID" "$cachedfp"
+				stopElfutils
+			fi
+		else
+			usekbuild=1
+		fi
+	fi
+
+	if [[ $usekbuild != 0 ]]; then
+		logInfo "Use kbuild to build modules"
+		# kbuild rebuilds the origin object, so cached fingerprints may not match it
+		rm -f "$moduledir/_$filename.fp"
+		generateMakefile "$moduledir/Makefile" "$file"
+
+		prepareToBuild "$moduledir" "$basename"
+		buildModules "$moduledir"
+	fi
 }
 
 generateDiffObject()
 {
 	local moduledir=$1
 	local file=$2
+	local out=$3
 	local filename=$(filenameNoExt "$file")
-	local out=`./elfutils --diff -a "$moduledir/_$filename.o" -b "$moduledir/$filename.o"`
-	local tmpmodfun=`sed -n "s/^Modified function: \(.\+\)/\1/p" <<< "$out"`
-	local newfun=`sed -n "s/^New function: \(.\+\)/\1/p" <<< "$out"`
+	local tmpmodfun=""
+	local newfun=""
 	local modfun=()
+	local -A funclass funcallers funtrace funinlined funcount objs counts
+	local kind name class callers keys trace inlined dups
+	# records from "elfutils --diff -r"
+	while IFS=$'\t' read -r kind name class callers keys trace inlined dups
+	do
+		if [[ "$kind" == "modified" ]]; then
+			tmpmodfun+="$name"$'\n'
+			funclass[$name]=$class
+			funcallers[$name]=$callers
+			funtrace[$name]=$trace
+			funinlined[$name]=$inlined
+			funcount[$name]=$dups
+			[[ "$keys" == 1 ]] && logDebug "The '$name' function uses static keys"
+		elif [[ "$kind" == "new" ]]; then
+			newfun+="$name"$'\n'
+		fi
+	done <<< "$out"
+	[[ "$tmpmodfun" != "" ]] && findObjsWithSymbols objs counts $tmpmodfun
 
 	while read -r fun
 	do
 		[[ $fun == "" ]] && continue
-		local initfunc=`objdump -t -j ".init.text" "$moduledir/_$filename.o" 2>/dev/null | grep "\b$fun\b"`
-		if [[ "$initfunc" != "" ]]; then
+		if [[ "${funclass[$fun]}" == "init" ]]; then
 			logInfo "Detected modifications in the init function '$fun'. Modifications from this function will not be applied."
 			continue
 		fi
-		local initfunc=`objdump -t -j ".exit.text" "$moduledir/_$filename.o" 2>/dev/null | grep "\b$fun\b"`
-		if [[ "$initfunc" != "" ]]; then
+		if [[ "${funclass[$fun]}" == "exit" ]]; then
 			logInfo "Detected modifications in the exit function '$fun'. Modifications from this function will not be applied."
 			continue
 		fi
-		if [[ $fun == *".cold" ]]; then
+		if [[ "${funclass[$fun]}" == "cold" ]]; then
 			local originfun=${fun%.*}
-			local calls=`./elfutils --callchain -f "$moduledir/$filename.o" | \
-						 grep -E "\b$fun \b"`
-			local callswithparent=`./elfutils --callchain -f "$moduledir/$filename.o" | \
-								    grep -E "\b$fun $originfun\b"`
 			# check if ".cold" part of function is only called by the origin
 			# function. If not, then disallow for changes
-			if [[ "$calls" != "$callswithparent" ]]; then
+			if [[ "${funcallers[$fun]}" != "-" && "${funcallers[$fun]}" != "$originfun" ]]; then
 				logErr "Can't apply changes to '$file' because the compiler in this file has optimized the '$originfun' function and split it into two parts. This is not yet supported by DEKU."
 				exit $ERROR_NO_SUPPORT_COLD_FUN
 			fi
-		elif ! isTraceable "$BUILD_DIR/${file%.*}.o" $fun; then
+		elif [[ "${funtrace[$fun]}" == "notrace" ]]; then
 			logErr "Can't apply changes to the '$file' because the '$fun' function is forbidden to modify."
 			exit $ERROR_FORBIDDEN_MODIFY
 		fi
 
-		local objpath=$(findObjWithSymbol $fun "$file")
+		local objpath=${objs[$fun]}
+		local count=${counts[$fun]}
+		if [[ "$objpath" == "" ]]; then
+			objpath=$(findObjWithSymbol $fun "$file")
+			count=${funcount[$fun]}
+		fi
 		if [[ "$objpath" == "vmlinux" ]]; then
-			local count=`nm "$BUILD_DIR/$objpath" | grep "\b$fun\b" | wc -l`
 			if [[ $count > 1 ]]; then
 				logErr "Can't apply changes to '$file' because there are multiple functions with the '$fun' name in the kernel image. This is not yet supported by DEKU."
 				exit $ERROR_NO_SUPPORT_MULTI_FUNC
@@ -287,40 +522,40 @@ generateDiffObject()
 		modfun+=("$fun")
 	done <<< "$tmpmodfun"
 
-	printf "%s\n" "${modfun[@]}" > "$moduledir/$MOD_SYMBOLS_FILE"
-
-	[[ "$newfun" == "" && ${#modfun[@]} == 0 ]] && return 0
+	# functions inlined in the origin file are replaced by their callers
+	local -A modsym extracted
+	local modsyms=()
+	for fun in "${modfun[@]}"; do
+		[[ "${funinlined[$fun]}" == 1 ]] && continue
+		modsym[$fun]=1
+		modsyms+=("$fun")
+	done
 
-	local originfuncs=`nm -C -f posix "$BUILD_DIR/${file%.*}.o" | grep -i " t " | cut -d ' ' -f 1`
 	local extractsyms=""
-	for fun in ${modfun[@]};
+	for fun in "${modfun[@]}";
 	do
-		[[ "$fun" == "" ]] && continue
 		# if modified function is inlined in origin file then get functions that call
 		# this function and make DEKU module for those functions
-		if ! grep -q "\b$fun\b" <<< "$originfuncs"; then
+		if [[ "${funinlined[$fun]}" == 1 ]]; then
 			logDebug "$fun function in $file is inlined"
-			sed -i "/\b$fun\b/d" "$moduledir/$MOD_SYMBOLS_FILE"
-			local calls=`./elfutils --callchain -f "$moduledir/$filename.o" | grep -E "^\b$fun\b"`
+			# chains of callers that ends on the first function from origin file
+			local calls
+			runElfutils calls --callchain -f "$moduledir/$filename.o" -u "$fun" \
+						-p "$BUILD_DIR/${file%.*}.o"
 			while read -r chain;
 			do
-				# check if the call chain contains only one function from origin file
-				local count=0
-				local originfun=""
-				local toextract=""
-				for s in $chain; do
-					if grep -q "\b$s\b" <<< "$originfuncs"; then
-						((count=count+1))
-						[[ $count > 1 ]] && break
-						originfun=$s
-					fi
-					# add to list if another function in call chain is inlined
-					[[ $count == 0 ]] && ! grep -q "\b$s\b" <<< "$extractsyms" && toextract+="-s $s "
+				[[ "$chain" == "" ]] && continue
+				local originfun=${chain##* }
+				# add to list other inlined functions in the call chain
+				for s in ${chain% *}; do
+					[[ "${extracted[$s]}" ]] && continue
+					extracted[$s]=1
+					extractsyms+="-s $s "
 				done
-				if [[ $count == 1 ]]; then
-					extractsyms+="$toextract"
-					extractsyms+="-s $originfun "
-					echo "$originfun" >> "$moduledir/$MOD_SYMBOLS_FILE"
+				extractsyms+="-s $originfun "
+				if [[ -z "${modsym[$originfun]}" ]]; then
+					modsym[$originfun]=1
+					modsyms+=("$originfun")
 				fi
 			done <<< "$calls"
 		else
@@ -328,14 +563,20 @@ generateDiffObject()
 		fi
 	done
 
+	printf "%s\n" "${modsyms[@]}" > "$moduledir/$MOD_SYMBOLS_FILE"
+
+	[[ "$newfun" == "" && ${#modfun[@]} == 0 ]] && return 0
+
 	while read -r fun;
 	do
 		[[ "$fun" == "" ]] && continue
 		extractsyms+="-s $fun "
 	done <<< "$newfun"
 
-	./elfutils --extract -f "$moduledir/$filename.o" -o "$moduledir/patch.o" $extractsyms
+	local extractout
+	runElfutils extractout --extract -f "$moduledir/$filename.o" -o "$moduledir/patch.o" $extractsyms
 	local rc=$?
+	echo -n "$extractout"
 	if [[ $rc == $ERROR_UNSUPPORTED_READ_MOSTLY ]]; then
 		exit $ERROR_UNSUPPORTED_READ_MOSTLY
 	fi
@@ -357,10 +598,13 @@ generateLivepatchSource()
 	local prototypes=""
 
 	local objname
+	local -A objs counts
+	findObjsWithSymbols objs counts $(<$modsymfile)
 
 	# find object for modified functions
 	while read -r symbol; do
-		objname=$(findObjWithSymbol $symbol "$file")
+		objname=${objs[$symbol]}
+		[ -z "$objname" ] && objname=$(findObjWithSymbol $symbol "$file")
 		[ ! -z "$objname" ] && { echo $objname > "$moduledir/$FILE_OBJECT"; break; }
 	done < $modsymfile
 	if [ -z "$objname" ]; then
@@ -419,6 +663,107 @@ generateLivepatchSource()
 	cat $MODULE_SUFFIX_FILE >> $outfile
 }
 
+# Get path of the cached module for the given module id and synced kernel version
+cachedModulePath()
+{
+	local module=$1
+	local moduleid=$2
+	local key=`echo "$(<$KERNEL_VERSION_FILE) $module $moduleid" | md5sum | cut -d' ' -f1`
+	echo "$MODULE_CACHE_DIR/$key"
+}
+
+storeCachedModule()
+{
+	local moduledir=$1
+	local module=$2
+	local moduleid=$3
+	local entry=$(cachedModulePath "$module" "$moduleid")
+	local tmp="$entry.$BASHPID"
+
+	mkdir -p "$tmp"
+	cp "$moduledir/$module.ko" "$moduledir/$MOD_SYMBOLS_FILE" "$moduledir/$FILE_OBJECT" \
+	   "$moduledir/$FILE_SRC_PATH" "$moduledir/$NOTE_FILE" "$moduledir/id" "$tmp/" || \
+	   { rm -rf "$tmp"; return; }
+	# other job could store the same module in the meantime
+	mv -T "$tmp" "$entry" 2>/dev/null || rm -rf "$tmp"
+}
+
+restoreCachedModule()
+{
+	local file=$1
+	local module=$2
+	local moduleid=$3
+	local moduledir="$workdir/$module"
+	local entry=$(cachedModulePath "$module" "$moduleid")
+
+	[[ -f "$entry/id" ]] || return 1
+	rm -rf $moduledir
+	mkdir $moduledir
+	cp "$entry"/* "$moduledir/" || return 1
+	getFileDiff $file > "$moduledir/diff"
+	# mark as recently used
+	touch "$entry"
+}
+
+# Remove least recently used modules when the cache exceeds the size limit
+trimModuleCache()
+{
+	[[ -d "$MODULE_CACHE_DIR" ]] || return
+	local size=`du -sk "$MODULE_CACHE_DIR" | cut -f1`
+	local entries=`find "$MODULE_CACHE_DIR" -mindepth 1 -maxdepth 1 -type d -printf "%T@ %p\n" | \
+				   sort -n | cut -d' ' -f2-`
+	while read -r entry
+	do
+		[[ $size -le $MODULE_CACHE_LIMIT || "$entry" == "" ]] && break
+		local entrysize=`du -sk "$entry" | cut -f1`
+		logDebug "Remove cached module $entry"
+		rm -rf "$entry"
+		size=$((size - entrysize))
+	done <<< "$entries"
+}
+
+# Generate the livepatch module for the file from the result of the objects
+# comparison
+generateModule()
+{
+	local file=$1
+	local module=$2
+	local moduleid=$3
+	local diff=$4
+	local moduledir="$workdir/$module"
+
+	if generateDiffObject "$moduledir" "$file" "$diff"; then
+		logInfo "No valid changes found in '$file'"
+		return 0
+	fi
+
+	generateLivepatchSource "$moduledir" "$file" || return 0
+	generateLivepatchMakefile "$moduledir/Makefile" "$file" "$module"
+	buildLivepatchModule "$moduledir"
+
+	echo -n "$moduleid" > "$moduledir/id"
+
+	# Add note to module with module name and id
+	local notefile="$moduledir/$NOTE_FILE"
+	echo -n "$module " > "$notefile"
+	cat "$moduledir/id" >> "$notefile"
+	echo "" >> "$notefile"
+
+	# restore calls to origin func XYZ instead of __deku_XYZ, remove __deku_XYZ
+	# symbols and add the note in one write of the module
+	local args=()
+	while read -r symbol; do
+		[[ "$symbol" == "" ]] && continue
+		args+=(-s "${symbol//./_}")
+	done < "$moduledir/$MOD_SYMBOLS_FILE"
+	local finalizeout
+	runElfutils finalizeout --finalize -p "$DEKU_FUN_PREFIX" "${args[@]}" \
+				-n "$notefile" "$moduledir/$module.ko" || exit $ERROR_CHANGE_CALL_TO_ORIGIN
+	echo -n "$finalizeout"
+	storeCachedModule "$moduledir" "$module" "$moduleid"
+	stopElfutils
+}
+
 postBuild()
 {
 	[[ $RUN_POST_BUILD != 1 ]] && return
@@ -458,10 +803,14 @@ main()
 		RUN_POST_BUILD=1
 	fi
 
+	initJobs
+
+	local builtfiles=()
+	local diffargs=()
+	declare -A modules
+	declare -A moduleids
 	for file in $files
 	do
-		local basename=`basename $file`
-		local filename=$(filenameNoExt "$file")
 		if ! buildInKernel "$file"; then
 			logWarn "File '$file' is not used in the kernel or module. Skip"
 			continue
@@ -474,71 +823,65 @@ main()
 			local prev=$(<$moduledir/id)
 			[ "$prev" == "$moduleid" ] && continue
 		fi
+		if restoreCachedModule "$file" "$module" "$moduleid"; then
+			logInfo "Use previously built module for '$file'"
+			continue
+		fi
 
 		rm -rf $moduledir
 		mkdir $moduledir
+		startJob "$moduledir/$BUILD_LOG_FILE" buildObjects "$file" "$moduledir"
 
-		# write diff to file for debug purpose
-		getFileDiff $file > "$moduledir/diff"
-
-		# file name with prefix '_' is the origin file
-		if [ "$KERN_SRC_INSTALL_DIR" ]; then
-			cp "$KERN_SRC_INSTALL_DIR/$file" "$moduledir/_$basename"
-		else
-			git -C $workdir cat-file blob ":$file" > "$moduledir/_$basename"
-		fi
-
-		cp "$SOURCE_DIR/$file" "$moduledir/$basename"
-		echo -n "$file" > "$moduledir/$FILE_SRC_PATH"
-
-		local usekbuild=0
-		buildFile $file "$moduledir/_$basename" "$moduledir/_$filename.o"
-		usekbuild=$?
-		if [[ $usekbuild == 0 ]]; then
-			buildFile $file "$moduledir/$basename" "$moduledir/$filename.o"
-			usekbuild=$?
-		fi
-
-		if [[ $usekbuild != 0 ]]; then
-			logInfo "Use kbuild to build modules"
-			generateMakefile "$moduledir/Makefile" "$file"
-
-			prepareToBuild "$moduledir" "$basename"
-			buildModules "$moduledir"
-		fi
+		builtfiles+=("$file")
+		modules[$file]=$module
+		moduleids[$file]=$moduleid
+	done
+	waitForJobs || exit $?
 
-		if generateDiffObject "$moduledir" "$file"; then
-			logInfo "No valid changes found in '$file'"
+	for file in "${builtfiles[@]}"
+	do
+		local moduledir="$workdir/${modules[$file]}"
+		local filename=$(filenameNoExt "$file")
+		local origin="$moduledir/_$filename.o"
+		[[ -f "$moduledir/_$filename.fp" ]] && origin="$moduledir/_$filename.fp"
+		# object of the running kernel tells which functions are inlined
+		local kernobj="$BUILD_DIR/${file%.*}.o"
+		[[ -f "$kernobj" ]] || kernobj="$moduledir/_$filename.o"
+		diffargs+=(-a "$origin" -b "$moduledir/$filename.o" -l "$file" -k "$kernobj")
+	done
+	[[ -f "$BUILD_DIR/vmlinux" ]] && diffargs+=(-m "$BUILD_DIR/vmlinux")
+
+	# compare all files at once, output of each file starts with "File: <FILE>"
+	local diffout
+	declare -A diffs
+	local difffile=
+	local line
+	[[ ${#builtfiles[@]} != 0 ]] && runElfutils diffout --diff -r "${diffargs[@]}"
+	while IFS= read -r line
+	do
+		if [[ "$line" == "File: "* ]]; then
+			difffile=${line#File: }
 			continue
 		fi
+		[[ "$difffile" == "" ]] && continue
+		diffs[$difffile]+="$line"$'\n'
+	done <<< "$diffout"
 
-		generateLivepatchSource "$moduledir" "$file" || continue
-		generateLivepatchMakefile "$moduledir/Makefile" "$file" "$module"
-		buildLivepatchModule "$moduledir"
-
-		# restore calls to origin func XYZ instead of __deku_XYZ
-		while read -r symbol; do
-			local plainsymbol="${symbol//./_}"
-			./elfutils --changeCallSymbol -s ${DEKU_FUN_PREFIX}${plainsymbol} -d ${plainsymbol} \
-					   "$moduledir/$module.ko" || exit $ERROR_CHANGE_CALL_TO_ORIGIN
-			objcopy --strip-symbol=${DEKU_FUN_PREFIX}${plainsymbol} "$moduledir/$module.ko"
-		done < "$moduledir/$MOD_SYMBOLS_FILE"
-
-		echo -n "$moduleid" > "$moduledir/id"
-
-		# Add note to module with module name and id
-		local notefile="$moduledir/$NOTE_FILE"
-		echo -n "$module " > "$notefile"
-		cat "$moduledir/id" >> "$notefile"
-		echo "" >> "$notefile"
-		objcopy --add-section .note.deku="$notefile" \
-				--set-section-flags .note.deku=alloc,readonly \
-				"$moduledir/$module.ko"
-
+	for file in "${builtfiles[@]}"
+	do
+		local module=${modules[$file]}
+		startJob "$workdir/$module/$MODULE_LOG_FILE" generateModule "$file" "$module" \
+				 "${moduleids[$file]}" "${diffs[$file]}"
 	done
+	waitForJobs || exit $?
+	trimModuleCache
+	stopElfutils
 	postBuild
 }
 
+# functions of the script can be used by tests that source it
+[[ "${BASH_SOURCE[0]}" != "$0" ]] && return
+
 trap postBuild EXIT
 
 main $@
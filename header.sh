@@ -17,9 +17,30 @@ export FILE_SRC_PATH=path
 # file for note in module
 export NOTE_FILE=note
 
+# logs of the jobs that build objects and generate module for the file
+export BUILD_LOG_FILE=build_objects.log
+export MODULE_LOG_FILE=generate_module.log
+
 # dir with kernel's object symbols
 export SYMBOLS_DIR="$workdir/symbols"
 
+# index of symbols from the kernel image and modules built at sync
+export SYMBOL_INDEX_FILE="$workdir/symbols.idx"
+
+# state of source files at the sync time and list of files touched since then
+export SOURCE_MANIFEST_FILE="$workdir/manifest"
+export SOURCE_DIRTY_FILE="$workdir/dirty"
+
+# set to 1 to watch sources with inotify instead of checking all files
+export SOURCE_WATCHER=0
+
+# dir with origin objects built since the last sync
+export PRISTINE_CACHE_DIR="$workdir/pristine"
+
+# dir with previously built modules and the limit of its size in KiB
+export MODULE_CACHE_DIR="$workdir/modules"
+export MODULE_CACHE_LIMIT=262144
+
 # configuration file
 export CONFIG_FILE="$workdir/config"
 
@@ -54,25 +54,146 @@ typedef struct
 	char *secName;
 } RelaSym;
 
+// string table that is built in memory and written to the section at the end
+typedef struct
+{
+	Elf_Scn *scn;
+	char *buf;
+	size_t size;
+	size_t capacity;
+	// open addressing hash table of offsets + 1 of strings in the buffer
+	size_t *slots;
+	size_t slotsCount;
+	size_t stringsCount;
+} StrtabBuilder;
+
+typedef struct
+{
+	size_t shstrndx;
+	Elf_Scn *symtab;
+	Elf_Scn *strtab;
+	Elf_Scn *shstrtab;
+} ElfSections;
+
 size_t relaSectionCount = 0;
 
+ElfSections Sections;
+StrtabBuilder Strtab;
+StrtabBuilder Shstrtab;
+
 Symbol *symToRelocate = NULL;
 size_t symToRelocateCnt = 0;
 char **funToReplace = NULL;
 
-static int appendString(GElf_Shdr *shdr, Elf_Data *data, const char *text)
+// open addressing hash table of indexes + 1 in symToRelocate, keyed by fName
+size_t *RelocateSlots = NULL;
+size_t RelocateSlotsCount = 0;
+
+static uint32_t nameHash(const char *name)
+{
+	uint32_t h = 5381;
+	for (const uint8_t *c = (const uint8_t *)name; *c != '\0'; c++)
+		h = (h << 5) + h + *c;
+	return h;
+}
+
+static void strtabInsertSlot(StrtabBuilder *strtab, size_t offset)
+{
+	size_t i = nameHash(strtab->buf + offset) & (strtab->slotsCount - 1);
+	while (strtab->slots[i] != 0)
+		i = (i + 1) & (strtab->slotsCount - 1);
+	strtab->slots[i] = offset + 1;
+	strtab->stringsCount++;
+}
+
+static size_t strtabFind(const StrtabBuilder *strtab, const char *text)
+{
+	if (strtab->slotsCount == 0)
+		return 0;
+	size_t i = nameHash(text) & (strtab->slotsCount - 1);
+	for (; strtab->slots[i] != 0; i = (i + 1) & (strtab->slotsCount - 1))
+	{
+		if (strcmp(strtab->buf + strtab->slots[i] - 1, text) == 0)
+			return strtab->slots[i];
+	}
+	return 0;
+}
+
+static void strtabIndex(StrtabBuilder *strtab, size_t offset)
+{
+	if ((strtab->stringsCount + 1) * 2 > strtab->slotsCount)
+	{
+		size_t *oldSlots = strtab->slots;
+		size_t oldCount = strtab->slotsCount;
+		strtab->slotsCount = oldCount ? oldCount * 2 : 64;
+		strtab->slots = calloc(strtab->slotsCount, sizeof(size_t));
+		CHECK_ALLOC(strtab->slots);
+		strtab->stringsCount = 0;
+		for (size_t i = 0; i < oldCount; i++)
+		{
+			if (oldSlots[i] != 0)
+				strtabInsertSlot(strtab, oldSlots[i] - 1);
+		}
+		free(oldSlots);
+	}
+	strtabInsertSlot(strtab, offset);
+}
+
+// Load the existing string table from the section
+static void strtabInit(StrtabBuilder *strtab, Elf_Scn *scn)
 {
-	size_t oldSize = data->d_size;
-	size_t newSize = data->d_size + strlen(text) + 1;
-	char *buf = (char *)malloc(newSize);
-	CHECK_ALLOC(buf);
-
-	memcpy(buf, data->d_buf, data->d_size);
-	strcpy(&buf[data->d_size], text);
-	data->d_buf = buf;
-	data->d_size = newSize;
-	shdr->sh_size = newSize;
-	return oldSize;
+	Elf_Data *data = elf_getdata(scn, NULL);
+	memset(strtab, 0, sizeof(*strtab));
+	strtab->scn = scn;
+	strtab->size = data->d_size > 0 ? data->d_size : 1;
+	strtab->capacity = strtab->size * 2;
+	strtab->buf = calloc(1, strtab->capacity);
+	CHECK_ALLOC(strtab->buf);
+	if (data->d_buf != NULL)
+		memcpy(strtab->buf, data->d_buf, data->d_size);
+	// the table might not end with the null character
+	if (strtab->buf[strtab->size - 1] != '\0')
+		strtab->size++;
+
+	for (size_t off = 1; off < strtab->size; off += strlen(strtab->buf + off) + 1)
+	{
+		if (strtab->buf[off] != '\0' && strtabFind(strtab, strtab->buf + off) == 0)
+			strtabIndex(strtab, off);
+	}
+}
+
+// Add string to the table and return its offset. The same string added again gets the same offset.
+static size_t strtabAdd(StrtabBuilder *strtab, const char *text)
+{
+	size_t found = strtabFind(strtab, text);
+	if (found != 0)
+		return found - 1;
+
+	size_t len = strlen(text) + 1;
+	if (strtab->size + len > strtab->capacity)
+	{
+		while (strtab->size + len > strtab->capacity)
+			strtab->capacity *= 2;
+		strtab->buf = realloc(strtab->buf, strtab->capacity);
+		CHECK_ALLOC(strtab->buf);
+	}
+	size_t offset = strtab->size;
+	memcpy(strtab->buf + offset, text, len);
+	strtab->size += len;
+	strtabIndex(strtab, offset);
+	return offset;
+}
+
+// Write the table to its section. Must be called before elf_update.
+static void strtabFinalize(StrtabBuilder *strtab)
+{
+	GElf_Shdr shdr;
+	Elf_Data *data = elf_getdata(strtab->scn, NULL);
+	data->d_buf = strtab->buf;
+	data->d_size = strtab->size;
+	gelf_getshdr(strtab->scn, &shdr);
+	shdr.sh_size = strtab->size;
+	gelf_update_shdr(strtab->scn, &shdr);
 }
 
 static void addSymbolToRelocate(const char *sym)
@@ -98,28 +219,67 @@ static void addSymbolToRelocate(const char *sym)
 	symToRelocate[symToRelocateCnt++] = s;
 }
 
-static Elf_Scn *getSectionByName(Elf *elf, const char *secName)
+// Index symToRelocate by name. For duplicated names the last entry wins.
+static void indexSymbolsToRelocate(void)
+{
+	RelocateSlotsCount = 64;
+	while (RelocateSlotsCount < symToRelocateCnt * 2)
+		RelocateSlotsCount *= 2;
+	RelocateSlots = calloc(RelocateSlotsCount, sizeof(size_t));
+	CHECK_ALLOC(RelocateSlots);
+	for (size_t i = 0; i < symToRelocateCnt; i++)
+	{
+		size_t slot = nameHash(symToRelocate[i].fName) & (RelocateSlotsCount - 1);
+		while (RelocateSlots[slot] != 0 &&
+			   strcmp(symToRelocate[RelocateSlots[slot] - 1].fName, symToRelocate[i].fName) != 0)
+			slot = (slot + 1) & (RelocateSlotsCount - 1);
+		RelocateSlots[slot] = i + 1;
+	}
+}
+
+// Return index + 1 of the symbol to relocate with the given name or 0 if there is no such symbol
+static size_t findSymbolToRelocate(const char *name)
+{
+	if (name == NULL)
+		return 0;
+	size_t slot = nameHash(name) & (RelocateSlotsCount - 1);
+	for (; RelocateSlots[slot] != 0; slot = (slot + 1) & (RelocateSlotsCount - 1))
+	{
+		if (strcmp(symToRelocate[RelocateSlots[slot] - 1].fName, name) == 0)
+			return RelocateSlots[slot];
+	}
+	return 0;
+}
+
+static void readSections(Elf *elf)
 {
 	Elf_Scn *scn = NULL;
 	GElf_Shdr shdr;
-	size_t shstrndx;
-	elf_getshdrstrndx(elf, &shstrndx);
 	while ((scn = elf_nextscn(elf, scn)) != NULL)
 	{
 		gelf_getshdr(scn, &shdr);
-		char *name = elf_strptr(elf, shstrndx, shdr.sh_name);
-		if (strcmp(name, secName) == 0)
-			return scn;
+		char *name = elf_strptr(elf, Sections.shstrndx, shdr.sh_name);
+		if (name == NULL)
+			continue;
+		if (strcmp(name, ".symtab") == 0)
+			Sections.symtab = scn;
+		else if (strcmp(name, ".strtab") == 0)
+			Sections.strtab = scn;
+		else if (strcmp(name, ".shstrtab") == 0)
+			Sections.shstrtab = scn;
 	}
-	return NULL;
+	if (Sections.symtab == NULL)
+		LOG_ERR("Failed to find .symtab section");
+	if (Sections.strtab == NULL)
+		LOG_ERR("Failed to find .strtab section");
+	if (Sections.shstrtab == NULL)
+		LOG_ERR("Failed to find .shstrtab section");
 }
 
-static char **getSymbolNames(Elf *elf)
+static char **getSymbolNames(Elf *elf, size_t *count)
 {
 	char **result;
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
+	Elf_Scn *scn = Sections.symtab;
 	GElf_Shdr shdr;
 	Elf_Data *data = elf_getdata(scn, NULL);
 	gelf_getshdr(scn, &shdr);
@@ -132,136 +292,111 @@ static char **getSymbolNames(Elf *elf)
 		gelf_getsym(data, i, &sym);
 		result[i] = elf_strptr(elf, shdr.sh_link, sym.st_name);
 	}
+	*count = cnt;
 	return result;
 }
 
-static void addRelocateSymToStrtab(Elf *elf)
+// For each symbol in .symtab get the index + 1 of its entry in symToRelocate or 0
+static size_t *getRelocateIndexes(char **names, size_t count)
+{
+	size_t *result = (size_t *)calloc(count + 1, sizeof(size_t));
+	CHECK_ALLOC(result);
+	for (size_t i = 0; i < count; i++)
+		result[i] = findSymbolToRelocate(names[i]);
+	return result;
+}
+
+static void addRelocateSymToStrtab(void)
 {
-	GElf_Shdr shdr;
-	Elf_Scn *scn = getSectionByName(elf, ".strtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .strtab section");
-	gelf_getshdr(scn, &shdr);
-	Elf_Data *data = elf_getdata(scn, NULL);
 	for(size_t i = 0; i < symToRelocateCnt; i++)
-	{
-		symToRelocate[i].symOff = appendString(&shdr, data, symToRelocate[i].sym);
-		if (symToRelocate[i].symOff == (size_t)-1)
-			LOG_ERR("Failed to add sybmol name '%s' to string table", symToRelocate[i].sym);
-	}
+		symToRelocate[i].symOff = strtabAdd(&Strtab, symToRelocate[i].sym);
 }
 
 static void addSectionStr(Elf *elf, RelaSym **relocs, const char *objName)
 {
-	GElf_Shdr shdr;
-	size_t shstrndx;
-	elf_getshdrstrndx(elf, &shstrndx);
-	Elf_Scn *scn = getSectionByName(elf, ".shstrtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .shstrtab section");
-	gelf_getshdr(scn, &shdr);
-	Elf_Data *data = elf_getdata(scn, NULL);
-	const char *lastName = "";
 	for (size_t i = 0; i < relaSectionCount; i++)
 	{
-		char *name = elf_strptr(elf, shstrndx, relocs[i]->shdr.sh_name);
-		if (strcmp(name, lastName) == 0)
-			continue;
-		lastName = name;
+		char *name = elf_strptr(elf, Sections.shstrndx, relocs[i]->shdr.sh_name);
 		char *relaSecName = (char *)malloc(16 + strlen(objName) + strlen(name));
 		CHECK_ALLOC(relaSecName);
 		sprintf(relaSecName, ".klp.rela.%s%s", objName, name + 5);
-		int off = appendString(&shdr, data, relaSecName);
-		if (off == -1)
-			LOG_ERR("Failed to add section '%s' to string table", relaSecName);
-		relocs[i]->shdr.sh_name = off;
+		relocs[i]->shdr.sh_name = strtabAdd(&Shstrtab, relaSecName);
 		relocs[i]->secName = relaSecName;
 		LOG_DEBUG("Add section '%s' to string table", relaSecName);
 	}
 }
 
-static int convSymToLpRelSym(Elf *elf)
+static int convSymToLpRelSym(char **names, const size_t *relocIdx, size_t symCount)
 {
-	GElf_Shdr shdr;
-	Elf_Scn *scn = getSectionByName(elf, ".symtab");
-	if (scn == NULL)
-		LOG_ERR("Failed to find .symtab section");
-	Elf_Data *data = elf_getdata(scn, NULL);
-	gelf_getshdr(scn, &shdr);
-	size_t cnt = shdr.sh_size / shdr.sh_entsize;
-	for (size_t i = 0; i < cnt; i++)
+	Elf_Data *data = elf_getdata(Sections.symtab, NULL);
+	for (size_t i = 0; i < symCount; i++)
 	{
+		if (relocIdx[i] == 0)
+			continue;
 		GElf_Sym sym;
 		gelf_getsym(data, i, &sym);
-		char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
-		for(size_t j = 0; j < symToRelocateCnt; j++)
-		{
-			if (strcmp(name, symToRelocate[j].fName) == 0)
-			{
-				sym.st_name = symToRelocate[j].symOff;
-				sym.st_shndx = 0xFF20;
-				LOG_DEBUG("Convert to livepatch symbol '%s'", name);
-			}
-		}
+		sym.st_name = symToRelocate[relocIdx[i] - 1].symOff;
+		sym.st_shndx = 0xFF20;
+		LOG_DEBUG("Convert to livepatch symbol '%s'", names[i]);
 		gelf_update_sym(data, i, &sym);
 	}
 	return 0;
 }
 
-static RelaSym **removeRelaSymbols(Elf *elf, char **names)
+static RelaSym **removeRelaSymbols(Elf *elf, const size_t *relocIdx, size_t symCount)
 {
 	RelaSym **result = NULL;
 	Elf_Scn *scn = NULL;
 	GElf_Shdr shdr;
-	size_t shstrndx;
 	GElf_Rela rela;
 	Elf_Data *data;
+	// relocations removed from the current section, reused between sections
+	GElf_Rela *removed = NULL;
+	size_t removedCapacity = 0;
 
-	elf_getshdrstrndx(elf, &shstrndx);
 	while ((scn = elf_nextscn(elf, scn)) != NULL)
 	{
 		gelf_getshdr(scn, &shdr);
 		if (shdr.sh_type != SHT_RELA)
 			continue;
-		char *secName = elf_strptr(elf, shstrndx, shdr.sh_name);
+		char *secName = elf_strptr(elf, Sections.shstrndx, shdr.sh_name);
 		if (strcmp(".rela.debug_info", secName) == 0 ||
 			strcmp(".rela__jump_table", secName) == 0)
 			continue;
-		RelaSym *relaSym = NULL;
 		data = elf_getdata(scn, NULL);
 		size_t j = 0;
+		size_t removedCnt = 0;
 		size_t cnt = shdr.sh_size / shdr.sh_entsize;
+		if (cnt > removedCapacity)
+		{
+			removedCapacity = cnt;
+			removed = (GElf_Rela *)realloc(removed, sizeof(GElf_Rela) * removedCapacity);
+			CHECK_ALLOC(removed);
+		}
 		for (size_t i = 0; i < cnt; i++)
 		{
 			gelf_getrela(data, i, &rela);
-			int idx = ELF64_R_SYM(rela.r_info);
-			size_t k;
-			for (k = 0; k < symToRelocateCnt; k++)
+			size_t idx = ELF64_R_SYM(rela.r_info);
+			if (idx < symCount && relocIdx[idx] != 0)
 			{
-				if (strcmp(names[idx], symToRelocate[k].fName) == 0)
-				{
-					if (relaSym == NULL)
-					{
-						relaSym = (RelaSym *)calloc(1, sizeof(RelaSym));
-						CHECK_ALLOC(relaSym);
-						relaSym->rela = (GElf_Rela *)malloc(sizeof(GElf_Rela) * cnt);
-						CHECK_ALLOC(relaSym->rela);
-					}
-					relaSym->shdr = shdr;
-					relaSym->rela[relaSym->relaCnt++] = rela;
-
-					LOG_DEBUG("Remove relocation '%s' from '%s'", symToRelocate[k].fName, secName);
-					break;
-				}
+				removed[removedCnt++] = rela;
+				LOG_DEBUG("Remove relocation '%s' from '%s'", symToRelocate[relocIdx[idx] - 1].fName, secName);
 			}
-			if (k == symToRelocateCnt)
+			else
 			{
 				gelf_update_rela(data, j, &rela);
 				j++;
 			}
 		}
-		if (relaSym != NULL)
+		if (removedCnt > 0)
 		{
+			RelaSym *relaSym = (RelaSym *)calloc(1, sizeof(RelaSym));
+			CHECK_ALLOC(relaSym);
+			relaSym->shdr = shdr;
+			relaSym->relaCnt = removedCnt;
+			relaSym->rela = (GElf_Rela *)malloc(sizeof(GElf_Rela) * removedCnt);
+			CHECK_ALLOC(relaSym->rela);
+			memcpy(relaSym->rela, removed, sizeof(GElf_Rela) * removedCnt);
 			result = (RelaSym **)realloc(result, sizeof(*result) * (relaSectionCount + 1));
 			CHECK_ALLOC(result);
 			result[relaSectionCount++] = relaSym;
@@ -270,6 +405,7 @@ static RelaSym **removeRelaSymbols(Elf *elf, char **names)
 			gelf_update_shdr(scn, &shdr);
 		}
 	}
+	free(removed);
 	return result;
 }
 
@@ -379,21 +515,33 @@ int main(int argc, char *argv[])
 		error(EXIT_FAILURE, 0, "problems opening '%s' as ELF file: %s",
 			  file, elf_errmsg(-1));
 
-	size_t shstrndx;
-	if (elf_getshdrstrndx(elf, &shstrndx))
+	if (elf_getshdrstrndx(elf, &Sections.shstrndx))
 		error(EXIT_FAILURE, errno, "cannot get section header string index");
 
-	char **symbolNames = getSymbolNames(elf);
-	RelaSym **relocs = removeRelaSymbols(elf, symbolNames);
-	addRelocateSymToStrtab(elf);
-	convSymToLpRelSym(elf);
+	readSections(elf);
+	strtabInit(&Strtab, Sections.strtab);
+	strtabInit(&Shstrtab, Sections.shstrtab);
+	size_t symbolsCount;
+	char **symbolNames = getSymbolNames(elf, &symbolsCount);
+	indexSymbolsToRelocate();
+	size_t *relocateIndexes = getRelocateIndexes(symbolNames, symbolsCount);
+	RelaSym **relocs = removeRelaSymbols(elf, relocateIndexes, symbolsCount);
+	addRelocateSymToStrtab();
+	convSymToLpRelSym(symbolNames, relocateIndexes, symbolsCount);
 	addSectionStr(elf, relocs, objName);
 	addRelaSection(elf, relocs, symbolNames);
+	strtabFinalize(&Strtab);
+	strtabFinalize(&Shstrtab);
 
 	if (elf_update(elf, ELF_C_WRITE) == -1)
 		error(EXIT_FAILURE, 0, "elf_update failed: %s", elf_errmsg(-1));
 
+	elf_end(elf);
 	close(fd);
+	free(Strtab.buf);
+	free(Strtab.slots);
+	free(Shstrtab.buf);
+	free(Shstrtab.slots);
 	for (size_t i = 0; i < relaSectionCount; i++)
 	{
 		free(relocs[i]->secName);
@@ -401,6 +549,8 @@ int main(int argc, char *argv[])
 	free(relocs);
 	free(objName);
 	free(symbolNames);
+	free(relocateIndexes);
+	free(RelocateSlots);
 	free(symToRelocate);
 	free(funToReplace);
 
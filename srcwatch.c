@@ -0,0 +1,861 @@
+/*
+* Author: Marek Maślanka
+* Project: DEKU
+* URL: https://github.com/MarekMaslanka/deku
+*
+* Detect modified source files using the manifest of files taken at sync time
+* and optionally the inotify watcher that collects touched files
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define MANIFEST_MAGIC "srcwatch-manifest 1"
+// line in the dirty file which means that all files must be checked
+#define DIRTY_ALL "*"
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB)
+
+static bool ShowDebugLog = 0;
+#define LOG_ERR(fmt, ...)												\
+	do																	\
+	{																	\
+		fprintf(stderr, "ERROR (%s:%d): " fmt "\n", __FILE__, __LINE__,	\
+				##__VA_ARGS__);											\
+		exit(1);														\
+	} while (0)
+#define LOG_DEBUG(fmt, ...)												\
+	do																	\
+	{																	\
+		if (ShowDebugLog)												\
+			fprintf(stderr, fmt "\n", ##__VA_ARGS__);					\
+	} while (0)
+
+#define CHECK_ALLOC(m)	\
+	if (m == NULL)		\
+	LOG_ERR("Failed to alloc memory in %s (%s:%d)", __func__, __FILE__, __LINE__)
+
+// state of the source file at the sync time
+typedef struct
+{
+	char *path;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	// hash of the origin content of the file
+	uint64_t hash;
+	// the file was already different from the origin at the sync time
+	bool modified;
+} FileEntry;
+
+typedef struct
+{
+	FileEntry *entries;
+	size_t count;
+	size_t capacity;
+	// open addressing hash table of indexes + 1 of entries
+	size_t *slots;
+	size_t slotsCount;
+	// files that don't exist in the origin are reported as modified
+	bool reportNew;
+} Manifest;
+
+// set of paths, used to report each path once
+typedef struct
+{
+	char **paths;
+	size_t count;
+	size_t slotsCount;
+} PathSet;
+
+typedef struct
+{
+	int fd;
+	// relative path of the directory for each watch descriptor
+	char **dirs;
+	size_t dirsCount;
+} Watcher;
+
+typedef void (*FileCallback)(const char *path, const struct stat *st, void *arg);
+
+static uint32_t nameHash(const char *name)
+{
+	uint32_t h = 5381;
+	for (const uint8_t *c = (const uint8_t *)name; *c != '\0'; c++)
+		h = h * 33 + *c;
+	return h;
+}
+
+static uint64_t readLE64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// MurmurHash64A, the same hash as the "hash64" fingerprint in elfutils
+static uint64_t hash64(const uint8_t *data, size_t len, uint64_t seed)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	uint64_t h = seed ^ (len * m);
+	size_t blocks = len / 8;
+	for (size_t i = 0; i < blocks; i++)
+	{
+		uint64_t k = readLE64(data + i * 8);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	const uint8_t *tail = data + blocks * 8;
+	switch (len & 7)
+	{
+	case 7: h ^= (uint64_t)tail[6] << 48; /* fall through */
+	case 6: h ^= (uint64_t)tail[5] << 40; /* fall through */
+	case 5: h ^= (uint64_t)tail[4] << 32; /* fall through */
+	case 4: h ^= (uint64_t)tail[3] << 24; /* fall through */
+	case 3: h ^= (uint64_t)tail[2] << 16; /* fall through */
+	case 2: h ^= (uint64_t)tail[1] << 8; /* fall through */
+	case 1: h ^= (uint64_t)tail[0];
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+static bool hashFile(int dirFd, const char *path, uint64_t *hash)
+{
+	int fd = openat(dirFd, path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	static uint8_t buf[1 << 16];
+	uint64_t h = 0;
+	ssize_t len;
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		h = hash64(buf, len, h);
+	close(fd);
+	*hash = h;
+	return len == 0;
+}
+
+static bool isSourceFile(const char *name)
+{
+	size_t len = strlen(name);
+	return len > 2 && name[len - 2] == '.' && (name[len - 1] == 'c' || name[len - 1] == 'h');
+}
+
+static bool isSameFile(const FileEntry *entry, const struct stat *st)
+{
+	return entry->ino == st->st_ino && entry->size == st->st_size &&
+		   entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+		   entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static char *joinPath(const char *dir, const char *name)
+{
+	size_t dirLen = strlen(dir);
+	char *path = malloc(dirLen + strlen(name) + 2);
+	CHECK_ALLOC(path);
+	if (dirLen == 0)
+		strcpy(path, name);
+	else
+		sprintf(path, "%s/%s", dir, name);
+	return path;
+}
+
+static void addToPathSet(PathSet *set, const char *path)
+{
+	if ((set->count + 1) * 2 > set->slotsCount)
+	{
+		size_t slotsCount = set->slotsCount ? set->slotsCount * 2 : 1024;
+		char **paths = calloc(slotsCount, sizeof(char *));
+		CHECK_ALLOC(paths);
+		for (size_t i = 0; i < set->slotsCount; i++)
+		{
+			if (set->paths[i] == NULL)
+				continue;
+			size_t slot = nameHash(set->paths[i]) & (slotsCount - 1);
+			while (paths[slot] != NULL)
+				slot = (slot + 1) & (slotsCount - 1);
+			paths[slot] = set->paths[i];
+		}
+		free(set->paths);
+		set->paths = paths;
+		set->slotsCount = slotsCount;
+	}
+
+	size_t slot = nameHash(path) & (set->slotsCount - 1);
+	while (set->paths[slot] != NULL)
+	{
+		if (strcmp(set->paths[slot], path) == 0)
+			return;
+		slot = (slot + 1) & (set->slotsCount - 1);
+	}
+	set->paths[slot] = strdup(path);
+	CHECK_ALLOC(set->paths[slot]);
+	set->count++;
+}
+
+static bool isInPathSet(const PathSet *set, const char *path)
+{
+	if (set->slotsCount == 0)
+		return false;
+	size_t slot = nameHash(path) & (set->slotsCount - 1);
+	while (set->paths[slot] != NULL)
+	{
+		if (strcmp(set->paths[slot], path) == 0)
+			return true;
+		slot = (slot + 1) & (set->slotsCount - 1);
+	}
+	return false;
+}
+
+static void freePathSet(PathSet *set)
+{
+	for (size_t i = 0; i < set->slotsCount; i++)
+		free(set->paths[i]);
+	free(set->paths);
+	memset(set, 0, sizeof(*set));
+}
+
+static void addManifestEntry(Manifest *manifest, const FileEntry *entry)
+{
+	if (manifest->count == manifest->capacity)
+	{
+		manifest->capacity = manifest->capacity ? manifest->capacity * 2 : 1024;
+		manifest->entries = realloc(manifest->entries, manifest->capacity * sizeof(FileEntry));
+		CHECK_ALLOC(manifest->entries);
+	}
+	manifest->entries[manifest->count++] = *entry;
+}
+
+static void buildManifestIndex(Manifest *manifest)
+{
+	manifest->slotsCount = 1;
+	while (manifest->slotsCount < manifest->count * 2)
+		manifest->slotsCount <<= 1;
+	manifest->slots = calloc(manifest->slotsCount, sizeof(size_t));
+	CHECK_ALLOC(manifest->slots);
+	for (size_t i = 0; i < manifest->count; i++)
+	{
+		size_t slot = nameHash(manifest->entries[i].path) & (manifest->slotsCount - 1);
+		while (manifest->slots[slot] != 0)
+			slot = (slot + 1) & (manifest->slotsCount - 1);
+		manifest->slots[slot] = i + 1;
+	}
+}
+
+static FileEntry *findManifestEntry(const Manifest *manifest, const char *path)
+{
+	size_t slot = nameHash(path) & (manifest->slotsCount - 1);
+	while (manifest->slots[slot] != 0)
+	{
+		FileEntry *entry = &manifest->entries[manifest->slots[slot] - 1];
+		if (strcmp(entry->path, path) == 0)
+			return entry;
+		slot = (slot + 1) & (manifest->slotsCount - 1);
+	}
+	return NULL;
+}
+
+static void freeManifest(Manifest *manifest)
+{
+	for (size_t i = 0; i < manifest->count; i++)
+		free(manifest->entries[i].path);
+	free(manifest->entries);
+	free(manifest->slots);
+	memset(manifest, 0, sizeof(*manifest));
+}
+
+static void readManifest(const char *manifestFile, Manifest *manifest)
+{
+	FILE *f = fopen(manifestFile, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", manifestFile);
+
+	char *line = NULL;
+	size_t lineSize = 0;
+	int reportNew;
+	if (getline(&line, &lineSize, f) == -1 ||
+		strncmp(line, MANIFEST_MAGIC " ", strlen(MANIFEST_MAGIC) + 1) != 0 ||
+		sscanf(line + strlen(MANIFEST_MAGIC), "%d", &reportNew) != 1)
+		LOG_ERR("Invalid manifest file: %s", manifestFile);
+	manifest->reportNew = reportNew;
+
+	ssize_t len;
+	while ((len = getline(&line, &lineSize, f)) > 0)
+	{
+		FileEntry entry = {0};
+		int modified;
+		unsigned long long ino;
+		long long size;
+		long long sec;
+		long nsec;
+		int pathOffset;
+		if (line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		if (sscanf(line, "%d %llu %lld %lld.%ld %" SCNx64 " %n", &modified, &ino, &size, &sec, &nsec,
+				   &entry.hash, &pathOffset) != 6)
+			LOG_ERR("Invalid line in the manifest: %s", line);
+		entry.modified = modified;
+		entry.ino = ino;
+		entry.size = size;
+		entry.mtime.tv_sec = sec;
+		entry.mtime.tv_nsec = nsec;
+		entry.path = strdup(line + pathOffset);
+		CHECK_ALLOC(entry.path);
+		addManifestEntry(manifest, &entry);
+	}
+
+	free(line);
+	fclose(f);
+	buildManifestIndex(manifest);
+}
+
+static void addWatch(Watcher *watcher, int dirFd, const char *path)
+{
+	if (watcher == NULL || watcher->fd == -1)
+		return;
+
+	// inotify needs a path, use the one of the opened directory
+	char procPath[64];
+	snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", dirFd);
+	int wd = inotify_add_watch(watcher->fd, procPath, WATCH_EVENTS | IN_ONLYDIR);
+	if (wd == -1)
+	{
+		LOG_DEBUG("Can't watch '%s': %s", path, strerror(errno));
+		close(watcher->fd);
+		watcher->fd = -1;
+		return;
+	}
+
+	if ((size_t)wd >= watcher->dirsCount)
+	{
+		size_t dirsCount = watcher->dirsCount ? watcher->dirsCount : 1024;
+		while (dirsCount <= (size_t)wd)
+			dirsCount *= 2;
+		watcher->dirs = realloc(watcher->dirs, dirsCount * sizeof(char *));
+		CHECK_ALLOC(watcher->dirs);
+		memset(watcher->dirs + watcher->dirsCount, 0,
+			   (dirsCount - watcher->dirsCount) * sizeof(char *));
+		watcher->dirsCount = dirsCount;
+	}
+	free(watcher->dirs[wd]);
+	watcher->dirs[wd] = strdup(path);
+	CHECK_ALLOC(watcher->dirs[wd]);
+}
+
+/*
+ * Call the callback for each source file in the directory tree. Paths are
+ * relative to the root. Directories are added to the watcher, if any, before
+ * they are read, so no change is lost.
+ */
+static void walkTree(int dirFd, const char *path, Watcher *watcher, FileCallback callback, void *arg)
+{
+	addWatch(watcher, dirFd, path);
+	DIR *dir = fdopendir(dirFd);
+	if (dir == NULL)
+	{
+		close(dirFd);
+		return;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		const char *name = ent->d_name;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0)
+			continue;
+		if (ent->d_type != DT_DIR && ent->d_type != DT_REG && ent->d_type != DT_UNKNOWN)
+			continue;
+		if (ent->d_type == DT_REG && !isSourceFile(name))
+			continue;
+
+		struct stat st;
+		if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+		char *childPath = joinPath(path, name);
+		if (S_ISDIR(st.st_mode))
+		{
+			int childFd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (childFd != -1)
+				walkTree(childFd, childPath, watcher, callback, arg);
+		}
+		else if (S_ISREG(st.st_mode) && isSourceFile(name))
+		{
+			callback(childPath, &st, arg);
+		}
+		free(childPath);
+	}
+	closedir(dir);
+}
+
+static int openDir(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open directory '%s'", path);
+	return fd;
+}
+
+typedef struct
+{
+	int srcFd;
+	int baseFd;
+	// if set, only these files are added to the manifest
+	PathSet *tracked;
+	Manifest *manifest;
+} SnapshotContext;
+
+static void snapshotFile(const char *path, const struct stat *st, void *arg)
+{
+	SnapshotContext *ctx = arg;
+	FileEntry entry = {0};
+	if (ctx->tracked != NULL && !isInPathSet(ctx->tracked, path))
+		return;
+
+	uint64_t srcHash;
+	if (!hashFile(ctx->srcFd, path, &srcHash))
+		return;
+
+	entry.ino = st->st_ino;
+	entry.size = st->st_size;
+	entry.mtime = st->st_mtim;
+	entry.hash = srcHash;
+	if (ctx->baseFd != -1 && (!hashFile(ctx->baseFd, path, &entry.hash) || entry.hash != srcHash))
+		entry.modified = true;
+	entry.path = strdup(path);
+	CHECK_ALLOC(entry.path);
+	addManifestEntry(ctx->manifest, &entry);
+}
+
+static void readFileList(const char *listFile, PathSet *files)
+{
+	FILE *f = strcmp(listFile, "-") == 0 ? stdin : fopen(listFile, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", listFile);
+	char *line = NULL;
+	size_t lineSize = 0;
+	ssize_t len;
+	while ((len = getline(&line, &lineSize, f)) > 0)
+	{
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len > 0)
+			addToPathSet(files, line);
+	}
+	free(line);
+	if (f != stdin)
+		fclose(f);
+}
+
+static void writeManifest(const char *manifestFile, const Manifest *manifest)
+{
+	char *tmpFile = malloc(strlen(manifestFile) + 5);
+	CHECK_ALLOC(tmpFile);
+	sprintf(tmpFile, "%s.tmp", manifestFile);
+	FILE *f = fopen(tmpFile, "w");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot create file '%s'", tmpFile);
+
+	fprintf(f, MANIFEST_MAGIC " %d\n", manifest->reportNew);
+	for (size_t i = 0; i < manifest->count; i++)
+	{
+		const FileEntry *e = &manifest->entries[i];
+		fprintf(f, "%d %llu %lld %lld.%09ld %" PRIx64 " %s\n", e->modified, (unsigned long long)e->ino,
+				(long long)e->size, (long long)e->mtime.tv_sec, e->mtime.tv_nsec, e->hash, e->path);
+	}
+	if (fclose(f) != 0 || rename(tmpFile, manifestFile) == -1)
+		error(EXIT_FAILURE, errno, "Cannot write file '%s'", manifestFile);
+	free(tmpFile);
+}
+
+// Read PID of the watcher from the dirty file, returns 0 if watcher is not running
+static pid_t getWatcherPid(const char *dirtyFile)
+{
+	FILE *f = fopen(dirtyFile, "r");
+	if (f == NULL)
+		return 0;
+	int pid = 0;
+	if (fscanf(f, "pid %d", &pid) != 1)
+		pid = 0;
+	fclose(f);
+	if (pid <= 0 || kill(pid, 0) == -1)
+		return 0;
+
+	// the PID could be reused by other process
+	char commPath[64];
+	char comm[32] = "";
+	snprintf(commPath, sizeof(commPath), "/proc/%d/comm", pid);
+	f = fopen(commPath, "r");
+	if (f == NULL)
+		return 0;
+	if (fgets(comm, sizeof(comm), f) == NULL)
+		comm[0] = '\0';
+	fclose(f);
+	return strncmp(comm, "srcwatch", strlen("srcwatch")) == 0 ? pid : 0;
+}
+
+static void appendDirty(int fd, const char *path)
+{
+	if (dprintf(fd, "%s\n", path) < 0)
+		exit(1);
+}
+
+// Write paths of the touched source files to the dirty file until the watcher is killed
+static void runWatcher(Watcher *watcher, int dirtyFd)
+{
+	PathSet reported = {0};
+	bool reportedAll = false;
+	char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while (true)
+	{
+		ssize_t len = read(watcher->fd, buf, sizeof(buf));
+		if (len <= 0)
+		{
+			if (len == -1 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (char *p = buf; p < buf + len;)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				if (!reportedAll)
+					appendDirty(dirtyFd, DIRTY_ALL);
+				reportedAll = true;
+				continue;
+			}
+			if (event->wd < 0 || (size_t)event->wd >= watcher->dirsCount ||
+				watcher->dirs[event->wd] == NULL)
+				continue;
+			if (event->mask & IN_IGNORED)
+			{
+				// root of the sources is removed
+				if (event->wd == 1)
+					return;
+				free(watcher->dirs[event->wd]);
+				watcher->dirs[event->wd] = NULL;
+				continue;
+			}
+			if (event->len == 0)
+				continue;
+
+			char *path = joinPath(watcher->dirs[event->wd], event->name);
+			if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+			{
+				// files in the new directory can be created before it is watched
+				int dirFd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				if (dirFd != -1)
+				{
+					addWatch(watcher, dirFd, path);
+					close(dirFd);
+				}
+				if (!reportedAll)
+					appendDirty(dirtyFd, DIRTY_ALL);
+				reportedAll = true;
+				if (watcher->fd == -1)
+					return;
+			}
+			else if (isSourceFile(event->name) && !isInPathSet(&reported, path))
+			{
+				addToPathSet(&reported, path);
+				appendDirty(dirtyFd, path);
+			}
+			free(path);
+		}
+
+		// the dirty file is removed when the watcher is no longer needed
+		struct stat st;
+		if (fstat(dirtyFd, &st) == 0 && st.st_nlink == 0)
+			break;
+	}
+	freePathSet(&reported);
+}
+
+/*
+ * Take the manifest of source files. With the base directory, files are
+ * compared with the origin files from the base directory, otherwise current
+ * state of files is the origin. The list of files limits the manifest to the
+ * given files, other files are never reported. With the dirty file, the
+ * watcher is started in the background.
+ */
+static int snapshot(int argc, char *argv[])
+{
+	char *srcDir = NULL;
+	char *baseDir = NULL;
+	char *manifestFile = NULL;
+	char *dirtyFile = NULL;
+	char *listFile = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "d:b:m:w:l:V")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			srcDir = optarg;
+			break;
+		case 'b':
+			baseDir = optarg;
+			break;
+		case 'l':
+			listFile = optarg;
+			break;
+		case 'm':
+			manifestFile = optarg;
+			break;
+		case 'w':
+			dirtyFile = optarg;
+			break;
+		case 'V':
+			ShowDebugLog = true;
+			break;
+		}
+	}
+
+	if (srcDir == NULL || manifestFile == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to take snapshot. Valid parameters:"
+			  "-d <SRC_DIR> -m <MANIFEST_FILE> [-b <BASE_DIR> | -l <FILE_LIST>] [-w <DIRTY_FILE>] [-V]");
+
+	Watcher watcher = { .fd = -1 };
+	if (dirtyFile != NULL)
+	{
+		pid_t pid = getWatcherPid(dirtyFile);
+		if (pid != 0)
+			kill(pid, SIGTERM);
+		unlink(dirtyFile);
+		watcher.fd = inotify_init1(IN_CLOEXEC);
+	}
+
+	PathSet tracked = {0};
+	if (listFile != NULL)
+		readFileList(listFile, &tracked);
+
+	Manifest manifest = {0};
+	manifest.reportNew = baseDir != NULL;
+	SnapshotContext ctx = { .manifest = &manifest, .tracked = listFile ? &tracked : NULL };
+	ctx.srcFd = openDir(srcDir);
+	ctx.baseFd = baseDir != NULL ? openDir(baseDir) : -1;
+	walkTree(dup(ctx.srcFd), "", &watcher, snapshotFile, &ctx);
+	writeManifest(manifestFile, &manifest);
+	LOG_DEBUG("Manifest with %zu files saved to %s", manifest.count, manifestFile);
+	freeManifest(&manifest);
+	freePathSet(&tracked);
+	close(ctx.srcFd);
+	if (ctx.baseFd != -1)
+		close(ctx.baseFd);
+
+	if (watcher.fd == -1)
+		return EXIT_SUCCESS;
+
+	int dirtyFd = open(dirtyFile, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (dirtyFd == -1)
+		error(EXIT_FAILURE, errno, "Cannot create file '%s'", dirtyFile);
+
+	pid_t pid = fork();
+	if (pid == -1)
+		error(EXIT_FAILURE, errno, "Cannot start the watcher");
+	if (pid > 0)
+	{
+		dprintf(dirtyFd, "pid %d\n", pid);
+		LOG_DEBUG("Watcher started with PID %d", pid);
+		return EXIT_SUCCESS;
+	}
+
+	// paths reported by inotify are relative to the sources dir
+	setsid();
+	if (chdir(srcDir) == -1)
+		exit(1);
+	int nullFd = open("/dev/null", O_RDWR);
+	dup2(nullFd, STDIN_FILENO);
+	dup2(nullFd, STDOUT_FILENO);
+	dup2(nullFd, STDERR_FILENO);
+	close(nullFd);
+	runWatcher(&watcher, dirtyFd);
+	exit(EXIT_SUCCESS);
+}
+
+typedef struct
+{
+	int srcFd;
+	const Manifest *manifest;
+	PathSet *modified;
+} ChangesContext;
+
+static void checkFile(const char *path, const struct stat *st, void *arg)
+{
+	ChangesContext *ctx = arg;
+	const FileEntry *entry = findManifestEntry(ctx->manifest, path);
+	bool modified;
+	if (entry == NULL)
+	{
+		modified = ctx->manifest->reportNew;
+	}
+	else if (isSameFile(entry, st))
+	{
+		modified = entry->modified;
+	}
+	else
+	{
+		uint64_t hash;
+		modified = !hashFile(ctx->srcFd, path, &hash) || hash != entry->hash;
+	}
+	if (modified)
+		addToPathSet(ctx->modified, path);
+}
+
+static int comparePaths(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * Read the paths reported by the watcher. Returns false if the watcher is not
+ * running or all files must be checked.
+ */
+static bool readDirtyFiles(const char *dirtyFile, PathSet *dirty)
+{
+	if (getWatcherPid(dirtyFile) == 0)
+		return false;
+
+	FILE *f = fopen(dirtyFile, "r");
+	if (f == NULL)
+		return false;
+	char *line = NULL;
+	size_t lineSize = 0;
+	ssize_t len;
+	bool result = true;
+	// skip the line with PID
+	if (getline(&line, &lineSize, f) == -1)
+		result = false;
+	while (result && (len = getline(&line, &lineSize, f)) > 0)
+	{
+		// the watcher could be writing the line at the moment
+		if (line[len - 1] != '\n')
+			break;
+		line[len - 1] = '\0';
+		if (strcmp(line, DIRTY_ALL) == 0)
+			result = false;
+		else
+			addToPathSet(dirty, line);
+	}
+	free(line);
+	fclose(f);
+	return result;
+}
+
+// Print source files that are different from the origin
+static int changes(int argc, char *argv[])
+{
+	char *srcDir = NULL;
+	char *manifestFile = NULL;
+	char *dirtyFile = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "d:m:w:V")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			srcDir = optarg;
+			break;
+		case 'm':
+			manifestFile = optarg;
+			break;
+		case 'w':
+			dirtyFile = optarg;
+			break;
+		case 'V':
+			ShowDebugLog = true;
+			break;
+		}
+	}
+
+	if (srcDir == NULL || manifestFile == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to find changes. Valid parameters:"
+			  "-d <SRC_DIR> -m <MANIFEST_FILE> [-w <DIRTY_FILE>] [-V]");
+
+	Manifest manifest = {0};
+	readManifest(manifestFile, &manifest);
+	PathSet modified = {0};
+	ChangesContext ctx = { .srcFd = openDir(srcDir), .manifest = &manifest, .modified = &modified };
+	PathSet dirty = {0};
+	if (dirtyFile != NULL && readDirtyFiles(dirtyFile, &dirty))
+	{
+		LOG_DEBUG("Check %zu files reported by the watcher", dirty.count);
+		for (size_t i = 0; i < manifest.count; i++)
+		{
+			if (manifest.entries[i].modified)
+				addToPathSet(&dirty, manifest.entries[i].path);
+		}
+		for (size_t i = 0; i < dirty.slotsCount; i++)
+		{
+			struct stat st;
+			const char *path = dirty.paths[i];
+			if (path != NULL && fstatat(ctx.srcFd, path, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+				S_ISREG(st.st_mode))
+				checkFile(path, &st, &ctx);
+		}
+	}
+	else
+	{
+		LOG_DEBUG("Check all files");
+		walkTree(dup(ctx.srcFd), "", NULL, checkFile, &ctx);
+	}
+
+	char **paths = calloc(modified.count + 1, sizeof(char *));
+	CHECK_ALLOC(paths);
+	size_t count = 0;
+	for (size_t i = 0; i < modified.slotsCount; i++)
+	{
+		if (modified.paths[i] != NULL)
+			paths[count++] = modified.paths[i];
+	}
+	qsort(paths, count, sizeof(char *), comparePaths);
+	for (size_t i = 0; i < count; i++)
+		puts(paths[i]);
+
+	free(paths);
+	freePathSet(&dirty);
+	freePathSet(&modified);
+	freeManifest(&manifest);
+	close(ctx.srcFd);
+	return EXIT_SUCCESS;
+}
+
+static void help(const char *execName)
+{
+	error(EXIT_FAILURE, EINVAL, "Usage: %s [--snapshot|--changes] ...", execName);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--snapshot") == 0)
+		return snapshot(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--changes") == 0)
+		return changes(argc - 1, argv + 1);
+
+	help(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,753 @@
+/*
+* Author: Marek Maślanka
+* Project: DEKU
+* URL: https://github.com/MarekMaslanka/deku
+*
+* Index of symbols from the kernel image and all kernel modules used to find
+* the object with a symbol without scanning System.map and modules each time
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <gelf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "DEKUSYM1"
+#define VMLINUX "vmlinux"
+// entry is a symbol with the compiler suffix (e.g. foo.isra.0) found by "foo"
+#define ENTRY_ALIAS 0x1
+
+static bool ShowDebugLog = 0;
+#define LOG_ERR(fmt, ...)												\
+	do																	\
+	{																	\
+		fprintf(stderr, "ERROR (%s:%d): " fmt "\n", __FILE__, __LINE__,	\
+				##__VA_ARGS__);											\
+		exit(1);														\
+	} while (0)
+#define LOG_DEBUG(fmt, ...)												\
+	do																	\
+	{																	\
+		if (ShowDebugLog)												\
+			fprintf(stderr, fmt "\n", ##__VA_ARGS__);					\
+	} while (0)
+
+#define CHECK_ALLOC(m)	\
+	if (m == NULL)		\
+	LOG_ERR("Failed to alloc memory in %s (%s:%d)", __func__, __FILE__, __LINE__)
+
+/*
+ * Layout of the index file:
+ * IndexHeader
+ * uint32_t objects[objectsCount] - offsets of the object paths in strings
+ * uint32_t buckets[bucketsCount + 1] - index of the first entry in the bucket
+ * IndexEntry entries[entriesCount] - sorted by bucket, name and object
+ * char strings[stringsSize]
+ */
+typedef struct
+{
+	char magic[8];
+	uint32_t objectsCount;
+	uint32_t bucketsCount;
+	uint32_t entriesCount;
+	uint32_t stringsSize;
+} IndexHeader;
+
+typedef struct
+{
+	// offset of the name used to find the entry
+	uint32_t name;
+	// offset of the full symbol name
+	uint32_t symbol;
+	uint32_t hash;
+	uint32_t object;
+	// position (1-based) among the symbols with the same name in the object
+	uint16_t pos;
+	// number of the symbols with the same name in the object
+	uint16_t count;
+	char type;
+	uint8_t flags;
+	uint16_t reserved;
+} IndexEntry;
+
+typedef struct
+{
+	char *data;
+	size_t size;
+	size_t capacity;
+	// open addressing hash table of offsets + 1 of strings
+	uint32_t *slots;
+	size_t slotsCount;
+	size_t count;
+} StringTable;
+
+typedef struct
+{
+	IndexEntry *entries;
+	size_t count;
+	size_t capacity;
+	char **objects;
+	size_t objectsCount;
+	StringTable strings;
+} IndexBuilder;
+
+typedef struct
+{
+	void *map;
+	size_t size;
+	const IndexHeader *header;
+	const uint32_t *objects;
+	const uint32_t *buckets;
+	const IndexEntry *entries;
+	const char *strings;
+} Index;
+
+static uint32_t nameHash(const char *name, size_t len)
+{
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (uint8_t)name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void growStringSlots(StringTable *table)
+{
+	size_t slotsCount = table->slotsCount ? table->slotsCount * 2 : 1 << 16;
+	uint32_t *slots = calloc(slotsCount, sizeof(*slots));
+	CHECK_ALLOC(slots);
+	for (size_t i = 0; i < table->slotsCount; i++)
+	{
+		if (table->slots[i] == 0)
+			continue;
+		const char *str = table->data + table->slots[i] - 1;
+		size_t slot = nameHash(str, strlen(str)) & (slotsCount - 1);
+		while (slots[slot] != 0)
+			slot = (slot + 1) & (slotsCount - 1);
+		slots[slot] = table->slots[i];
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->slotsCount = slotsCount;
+}
+
+// add the string to the table if not exists and return its offset
+static uint32_t addString(StringTable *table, const char *str, size_t len)
+{
+	if ((table->count + 1) * 2 > table->slotsCount)
+		growStringSlots(table);
+
+	size_t slot = nameHash(str, len) & (table->slotsCount - 1);
+	while (table->slots[slot] != 0)
+	{
+		const char *s = table->data + table->slots[slot] - 1;
+		if (strncmp(s, str, len) == 0 && s[len] == '\0')
+			return table->slots[slot] - 1;
+		slot = (slot + 1) & (table->slotsCount - 1);
+	}
+
+	if (table->size + len + 1 > table->capacity)
+	{
+		table->capacity = (table->size + len + 1) * 2;
+		table->data = realloc(table->data, table->capacity);
+		CHECK_ALLOC(table->data);
+	}
+	if (table->size + len + 1 > UINT32_MAX)
+		LOG_ERR("Too many symbols to build the index");
+
+	uint32_t offset = table->size;
+	memcpy(table->data + offset, str, len);
+	table->data[offset + len] = '\0';
+	table->size += len + 1;
+	table->slots[slot] = offset + 1;
+	table->count++;
+	return offset;
+}
+
+static void addEntry(IndexBuilder *builder, const char *name, size_t nameLen,
+					 uint32_t symbol, uint32_t object, char type, uint8_t flags)
+{
+	if (builder->count == builder->capacity)
+	{
+		builder->capacity = builder->capacity ? builder->capacity * 2 : 1 << 16;
+		builder->entries = realloc(builder->entries, builder->capacity * sizeof(IndexEntry));
+		CHECK_ALLOC(builder->entries);
+	}
+	IndexEntry *entry = &builder->entries[builder->count++];
+	memset(entry, 0, sizeof(*entry));
+	entry->name = addString(&builder->strings, name, nameLen);
+	entry->symbol = symbol;
+	entry->hash = nameHash(name, nameLen);
+	entry->object = object;
+	entry->type = type;
+	entry->flags = flags;
+}
+
+static void addSymbol(IndexBuilder *builder, const char *name, uint32_t object, char type)
+{
+	size_t len = strlen(name);
+	if (len == 0)
+		return;
+
+	uint32_t symbol = addString(&builder->strings, name, len);
+	addEntry(builder, name, len, symbol, object, type, 0);
+	// symbols modified by the compiler are also found by the origin name
+	const char *dot = strchr(name, '.');
+	if (dot != NULL && dot != name)
+		addEntry(builder, name, dot - name, symbol, object, type, ENTRY_ALIAS);
+}
+
+static uint32_t addObject(IndexBuilder *builder, const char *path)
+{
+	builder->objects = realloc(builder->objects, (builder->objectsCount + 1) * sizeof(char *));
+	CHECK_ALLOC(builder->objects);
+	builder->objects[builder->objectsCount] = strdup(path);
+	CHECK_ALLOC(builder->objects[builder->objectsCount]);
+	return builder->objectsCount++;
+}
+
+static void readSystemMap(IndexBuilder *builder, const char *mapFile)
+{
+	FILE *f = fopen(mapFile, "r");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", mapFile);
+
+	uint32_t object = addObject(builder, VMLINUX);
+	char *line = NULL;
+	size_t len = 0;
+	while (getline(&line, &len, f) != -1)
+	{
+		char type;
+		char *name;
+		// <address> <type> <name>
+		char *p = strchr(line, ' ');
+		if (p == NULL || p[1] == '\0' || p[2] != ' ')
+			continue;
+		type = p[1];
+		name = p + 3;
+		name[strcspn(name, " \t\n")] = '\0';
+		if (type != 'U')
+			addSymbol(builder, name, object, type);
+	}
+	free(line);
+	fclose(f);
+}
+
+// symbol type in the same way as nm shows it
+static char symbolType(Elf *elf, const GElf_Sym *sym)
+{
+	char type = '?';
+	if (sym->st_shndx == SHN_UNDEF)
+		return 'U';
+	if (ELF64_ST_BIND(sym->st_info) == STB_WEAK)
+		return ELF64_ST_TYPE(sym->st_info) == STT_OBJECT ? 'V' : 'W';
+	if (sym->st_shndx == SHN_ABS)
+		type = 'A';
+	else if (sym->st_shndx == SHN_COMMON)
+		type = 'C';
+	else
+	{
+		GElf_Shdr shdr;
+		Elf_Scn *scn = elf_getscn(elf, sym->st_shndx);
+		if (scn == NULL || gelf_getshdr(scn, &shdr) == NULL)
+			type = '?';
+		else if (shdr.sh_flags & SHF_EXECINSTR)
+			type = 'T';
+		else if (shdr.sh_type == SHT_NOBITS)
+			type = 'B';
+		else if (shdr.sh_flags & SHF_WRITE)
+			type = 'D';
+		else if (shdr.sh_flags & SHF_ALLOC)
+			type = 'R';
+		else
+			type = 'N';
+	}
+	if (ELF64_ST_BIND(sym->st_info) == STB_LOCAL && type != '?')
+		type += 'a' - 'A';
+	return type;
+}
+
+static char *joinPath(const char *dir, const char *name)
+{
+	size_t dirLen = strlen(dir);
+	char *path = malloc(dirLen + strlen(name) + 2);
+	CHECK_ALLOC(path);
+	if (dirLen == 0)
+		strcpy(path, name);
+	else
+		sprintf(path, "%s/%s", dir, name);
+	return path;
+}
+
+static void readModule(IndexBuilder *builder, int dirFd, const char *path)
+{
+	int fd = openat(dirFd, path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", path);
+	Elf *elf = elf_begin(fd, ELF_C_READ, NULL);
+	if (elf == NULL)
+		LOG_ERR("elf_begin failed for '%s': %s", path, elf_errmsg(-1));
+
+	// modules are identified by the path without ".ko"
+	char *objPath = strdup(path);
+	CHECK_ALLOC(objPath);
+	objPath[strlen(objPath) - 3] = '\0';
+	uint32_t object = addObject(builder, objPath);
+	free(objPath);
+
+	Elf_Scn *scn = NULL;
+	while ((scn = elf_nextscn(elf, scn)) != NULL)
+	{
+		GElf_Shdr shdr;
+		if (gelf_getshdr(scn, &shdr) == NULL || shdr.sh_type != SHT_SYMTAB)
+			continue;
+		Elf_Data *data = elf_getdata(scn, NULL);
+		size_t count = shdr.sh_size / shdr.sh_entsize;
+		for (size_t i = 1; i < count; i++)
+		{
+			GElf_Sym sym;
+			if (gelf_getsym(data, i, &sym) == NULL)
+				continue;
+			if (ELF64_ST_TYPE(sym.st_info) == STT_SECTION ||
+				ELF64_ST_TYPE(sym.st_info) == STT_FILE ||
+				sym.st_shndx == SHN_UNDEF)
+				continue;
+			const char *name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+			if (name != NULL)
+				addSymbol(builder, name, object, symbolType(elf, &sym));
+		}
+	}
+
+	elf_end(elf);
+	close(fd);
+}
+
+typedef struct
+{
+	char **paths;
+	size_t count;
+} PathList;
+
+static bool isModule(const char *name)
+{
+	size_t len = strlen(name);
+	return len > 3 && strcmp(name + len - 3, ".ko") == 0;
+}
+
+// collect paths of all modules in the dir, symbolic links are not followed
+static void findModules(int dirFd, const char *path, PathList *modules)
+{
+	DIR *dir = fdopendir(dirFd);
+	if (dir == NULL)
+	{
+		close(dirFd);
+		return;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		const char *name = ent->d_name;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0)
+			continue;
+		if (ent->d_type != DT_DIR && ent->d_type != DT_REG && ent->d_type != DT_UNKNOWN)
+			continue;
+		if (ent->d_type == DT_REG && !isModule(name))
+			continue;
+
+		struct stat st;
+		if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+		char *childPath = joinPath(path, name);
+		if (S_ISDIR(st.st_mode))
+		{
+			int childFd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (childFd != -1)
+				findModules(childFd, childPath, modules);
+		}
+		else if (S_ISREG(st.st_mode) && isModule(name))
+		{
+			modules->paths = realloc(modules->paths, (modules->count + 1) * sizeof(char *));
+			CHECK_ALLOC(modules->paths);
+			modules->paths[modules->count++] = childPath;
+			continue;
+		}
+		free(childPath);
+	}
+	closedir(dir);
+}
+
+static int comparePaths(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void readModules(IndexBuilder *builder, const char *modulesDir)
+{
+	int dirFd = open(modulesDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirFd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open directory '%s'", modulesDir);
+
+	PathList modules = {0};
+	findModules(dup(dirFd), "", &modules);
+	qsort(modules.paths, modules.count, sizeof(char *), comparePaths);
+	for (size_t i = 0; i < modules.count; i++)
+	{
+		readModule(builder, dirFd, modules.paths[i]);
+		free(modules.paths[i]);
+	}
+	LOG_DEBUG("Read symbols from %zu modules", modules.count);
+	free(modules.paths);
+	close(dirFd);
+}
+
+static uint32_t BucketsMask;
+static const IndexEntry *SortEntries;
+static const char *SortStrings;
+
+// compare indexes of entries, entries of the same name and object keep the
+// order from the object
+static int compareEntries(const void *a, const void *b)
+{
+	uint32_t ia = *(const uint32_t *)a;
+	uint32_t ib = *(const uint32_t *)b;
+	const IndexEntry *x = &SortEntries[ia];
+	const IndexEntry *y = &SortEntries[ib];
+	uint32_t bx = x->hash & BucketsMask;
+	uint32_t by = y->hash & BucketsMask;
+	if (bx != by)
+		return bx < by ? -1 : 1;
+	if (x->name != y->name)
+		return strcmp(SortStrings + x->name, SortStrings + y->name);
+	if (x->flags != y->flags)
+		return x->flags < y->flags ? -1 : 1;
+	if (x->object != y->object)
+		return x->object < y->object ? -1 : 1;
+	return ia < ib ? -1 : ia > ib;
+}
+
+static void sortEntries(IndexBuilder *builder, uint32_t bucketsMask)
+{
+	uint32_t *order = malloc(builder->count * sizeof(uint32_t));
+	IndexEntry *entries = malloc(builder->count * sizeof(IndexEntry));
+	CHECK_ALLOC(order);
+	CHECK_ALLOC(entries);
+	for (size_t i = 0; i < builder->count; i++)
+		order[i] = i;
+
+	BucketsMask = bucketsMask;
+	SortEntries = builder->entries;
+	SortStrings = builder->strings.data;
+	qsort(order, builder->count, sizeof(uint32_t), compareEntries);
+	for (size_t i = 0; i < builder->count; i++)
+		entries[i] = builder->entries[order[i]];
+
+	free(builder->entries);
+	builder->entries = entries;
+	builder->capacity = builder->count;
+	free(order);
+}
+
+static void writeIndex(IndexBuilder *builder, const char *indexFile)
+{
+	IndexHeader header = {0};
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.objectsCount = builder->objectsCount;
+	header.entriesCount = builder->count;
+	header.bucketsCount = 1;
+	while (header.bucketsCount < builder->count)
+		header.bucketsCount <<= 1;
+
+	uint32_t *objects = calloc(header.objectsCount, sizeof(uint32_t));
+	CHECK_ALLOC(objects);
+	for (size_t i = 0; i < builder->objectsCount; i++)
+		objects[i] = addString(&builder->strings, builder->objects[i], strlen(builder->objects[i]));
+	header.stringsSize = builder->strings.size;
+
+	sortEntries(builder, header.bucketsCount - 1);
+
+	uint32_t *buckets = calloc(header.bucketsCount + 1, sizeof(uint32_t));
+	CHECK_ALLOC(buckets);
+	for (size_t i = 0; i < builder->count;)
+	{
+		IndexEntry *first = &builder->entries[i];
+		size_t end = i + 1;
+		while (end < builder->count && builder->entries[end].name == first->name &&
+			   builder->entries[end].flags == first->flags &&
+			   builder->entries[end].object == first->object)
+			end++;
+		for (size_t j = i; j < end; j++)
+		{
+			builder->entries[j].pos = j - i + 1;
+			builder->entries[j].count = end - i > UINT16_MAX ? UINT16_MAX : end - i;
+		}
+		buckets[(first->hash & (header.bucketsCount - 1)) + 1] = end;
+		i = end;
+	}
+	for (size_t i = 1; i <= header.bucketsCount; i++)
+	{
+		if (buckets[i] < buckets[i - 1])
+			buckets[i] = buckets[i - 1];
+	}
+
+	char *tmpFile = malloc(strlen(indexFile) + 16);
+	CHECK_ALLOC(tmpFile);
+	sprintf(tmpFile, "%s.%d", indexFile, getpid());
+	FILE *f = fopen(tmpFile, "w");
+	if (f == NULL)
+		error(EXIT_FAILURE, errno, "Cannot create file '%s'", tmpFile);
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(objects, sizeof(uint32_t), header.objectsCount, f);
+	fwrite(buckets, sizeof(uint32_t), header.bucketsCount + 1, f);
+	fwrite(builder->entries, sizeof(IndexEntry), builder->count, f);
+	fwrite(builder->strings.data, 1, builder->strings.size, f);
+	if (fclose(f) != 0 || rename(tmpFile, indexFile) != 0)
+	{
+		unlink(tmpFile);
+		error(EXIT_FAILURE, errno, "Cannot write file '%s'", indexFile);
+	}
+
+	LOG_DEBUG("Index with %u symbols from %u objects saved to %s", header.entriesCount,
+			  header.objectsCount, indexFile);
+	free(tmpFile);
+	free(buckets);
+	free(objects);
+}
+
+static void freeIndexBuilder(IndexBuilder *builder)
+{
+	for (size_t i = 0; i < builder->objectsCount; i++)
+		free(builder->objects[i]);
+	free(builder->objects);
+	free(builder->entries);
+	free(builder->strings.data);
+	free(builder->strings.slots);
+}
+
+/*
+ * Build the index from the System.map of the kernel image and all modules
+ * found in the modules dir
+ */
+static int build(int argc, char *argv[])
+{
+	char *indexFile = NULL;
+	char *mapFile = NULL;
+	char *modulesDir = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "o:s:k:V")) != -1)
+	{
+		switch (opt)
+		{
+		case 'o':
+			indexFile = optarg;
+			break;
+		case 's':
+			mapFile = optarg;
+			break;
+		case 'k':
+			modulesDir = optarg;
+			break;
+		case 'V':
+			ShowDebugLog = true;
+			break;
+		}
+	}
+
+	if (indexFile == NULL || mapFile == NULL)
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to build index. Valid parameters:"
+			  "-o <INDEX_FILE> -s <SYSTEM_MAP> [-k <MODULES_DIR>] [-V]");
+
+	IndexBuilder builder = {0};
+	readSystemMap(&builder, mapFile);
+	if (modulesDir != NULL)
+		readModules(&builder, modulesDir);
+	writeIndex(&builder, indexFile);
+	freeIndexBuilder(&builder);
+	return EXIT_SUCCESS;
+}
+
+static void openIndex(const char *indexFile, Index *index)
+{
+	int fd = open(indexFile, O_RDONLY);
+	if (fd == -1)
+		error(EXIT_FAILURE, errno, "Cannot open file '%s'", indexFile);
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		error(EXIT_FAILURE, errno, "Cannot stat file '%s'", indexFile);
+	index->size = st.st_size;
+	if (index->size < sizeof(IndexHeader))
+		LOG_ERR("Invalid index file '%s'", indexFile);
+	index->map = mmap(NULL, index->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (index->map == MAP_FAILED)
+		error(EXIT_FAILURE, errno, "Cannot map file '%s'", indexFile);
+
+	const IndexHeader *header = index->map;
+	size_t size = sizeof(IndexHeader) +
+				  (size_t)header->objectsCount * sizeof(uint32_t) +
+				  ((size_t)header->bucketsCount + 1) * sizeof(uint32_t) +
+				  (size_t)header->entriesCount * sizeof(IndexEntry) +
+				  header->stringsSize;
+	if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+		size != index->size || header->bucketsCount == 0 ||
+		(header->bucketsCount & (header->bucketsCount - 1)) != 0)
+		LOG_ERR("Invalid index file '%s'", indexFile);
+
+	index->header = header;
+	index->objects = (const uint32_t *)(header + 1);
+	index->buckets = index->objects + header->objectsCount;
+	index->entries = (const IndexEntry *)(index->buckets + header->bucketsCount + 1);
+	index->strings = (const char *)(index->entries + header->entriesCount);
+}
+
+static const char *objectName(const Index *index, uint32_t object)
+{
+	const char *path = index->strings + index->objects[object];
+	const char *name = strrchr(path, '/');
+	return name ? name + 1 : path;
+}
+
+/*
+ * Find entries of the symbol. Symbols with the exact name are returned, or
+ * if not exists, the symbols with the compiler suffix
+ */
+static const IndexEntry *findSymbol(const Index *index, const char *name, size_t *count)
+{
+	uint32_t hash = nameHash(name, strlen(name));
+	uint32_t bucket = hash & (index->header->bucketsCount - 1);
+	const IndexEntry *first = NULL;
+	*count = 0;
+	for (uint32_t i = index->buckets[bucket]; i < index->buckets[bucket + 1]; i++)
+	{
+		const IndexEntry *entry = &index->entries[i];
+		if (entry->hash != hash || strcmp(index->strings + entry->name, name) != 0)
+		{
+			if (first != NULL)
+				break;
+			continue;
+		}
+		if (first != NULL && entry->flags != first->flags)
+			break;
+		if (first == NULL)
+			first = entry;
+		(*count)++;
+	}
+	return first;
+}
+
+static void printEntry(const Index *index, const char *name, const IndexEntry *entry)
+{
+	printf("%s %s %s %c %u %u\n", name, objectName(index, entry->object),
+		   index->strings + index->objects[entry->object], entry->type, entry->pos,
+		   entry->count);
+}
+
+static void lookupSymbol(const Index *index, const char *name, bool showAll)
+{
+	size_t count;
+	const IndexEntry *entries = findSymbol(index, name, &count);
+	if (entries == NULL)
+	{
+		printf("%s -\n", name);
+		return;
+	}
+	for (size_t i = 0; i < (showAll ? count : 1); i++)
+		printEntry(index, name, &entries[i]);
+}
+
+/*
+ * Find objects with the symbols. For each symbol prints:
+ * <NAME> <OBJECT_NAME> <OBJECT_PATH> <TYPE> <POSITION> <COUNT>
+ * where the position is the position among the symbols with the same name in
+ * the object and the count is the number of such symbols. The first found
+ * object is printed, the kernel image is preferred. If the symbol can't be
+ * found "<NAME> -" is printed.
+ */
+static int lookup(int argc, char *argv[])
+{
+	char *indexFile = NULL;
+	char *listFile = NULL;
+	bool showAll = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:f:aV")) != -1)
+	{
+		switch (opt)
+		{
+		case 'i':
+			indexFile = optarg;
+			break;
+		case 'f':
+			listFile = optarg;
+			break;
+		case 'a':
+			showAll = true;
+			break;
+		case 'V':
+			ShowDebugLog = true;
+			break;
+		}
+	}
+
+	if (indexFile == NULL || (listFile == NULL && optind >= argc))
+		error(EXIT_FAILURE, EINVAL, "Invalid parameters to lookup symbols. Valid parameters:"
+			  "-i <INDEX_FILE> [-a] [-V] <-f <SYMBOLS_FILE> | SYMBOL...>");
+
+	Index index;
+	openIndex(indexFile, &index);
+	for (int i = optind; i < argc; i++)
+		lookupSymbol(&index, argv[i], showAll);
+
+	if (listFile != NULL)
+	{
+		FILE *f = strcmp(listFile, "-") == 0 ? stdin : fopen(listFile, "r");
+		if (f == NULL)
+			error(EXIT_FAILURE, errno, "Cannot open file '%s'", listFile);
+		char *line = NULL;
+		size_t len = 0;
+		ssize_t read;
+		while ((read = getline(&line, &len, f)) != -1)
+		{
+			if (read > 0 && line[read - 1] == '\n')
+				line[read - 1] = '\0';
+			if (line[0] != '\0')
+				lookupSymbol(&index, line, showAll);
+		}
+		free(line);
+		if (f != stdin)
+			fclose(f);
+	}
+
+	munmap(index.map, index.size);
+	return EXIT_SUCCESS;
+}
+
+static void help(const char *execName)
+{
+	error(EXIT_FAILURE, EINVAL, "Usage: %s [--build|--lookup] ...", execName);
+}
+
+int main(int argc, char *argv[])
+{
+	elf_version(EV_CURRENT);
+
+	if (argc > 1 && strcmp(argv[1], "--build") == 0)
+		return build(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--lookup") == 0)
+		return lookup(argc - 1, argv + 1);
+
+	help(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,57 @@
+#!/bin/bash
+# Author: Marek Maślanka
+# Project: DEKU
+# URL: https://github.com/MarekMaslanka/deku
+#
+# Benchmark mklivepatch on a synthetic module with many klp relocations
+# Usage: test/benchmark_mklivepatch.sh [SYMBOLS] [FUNCTIONS] [MKLIVEPATCH...]
+
+SYMBOLS=${1:-4000}
+FUNCTIONS=${2:-200}
+shift 2 2>/dev/null
+BINARIES=("$@")
+[[ ${#BINARIES[@]} == 0 ]] && BINARIES=(./mklivepatch)
+
+TMPDIR=`mktemp -d`
+trap "rm -rf $TMPDIR" EXIT
+
+generateModule()
+{
+	local src=$TMPDIR/bench.c
+	local perfun=$(( (SYMBOLS + FUNCTIONS - 1) / FUNCTIONS ))
+	{
+		for ((i = 0; i < SYMBOLS; i++)); do
+			echo "extern void ext_fun_$i(void);"
+		done
+		for ((f = 0; f < FUNCTIONS; f++)); do
+			echo "void bench_fun_$f(void)"
+			echo "{"
+			for ((i = f * perfun; i < (f + 1) * perfun && i < SYMBOLS; i++)); do
+				echo "	ext_fun_$i();"
+			done
+			# a relocation in each section that must stay untouched
+			echo "	bench_fun_0();"
+			echo "}"
+		done
+	} > $src
+	gcc -c -O0 -ffunction-sections -fno-asynchronous-unwind-tables $src -o $TMPDIR/bench.o || exit 1
+}
+
+generateModule
+
+args=(-V -s bench.bench_fun_0)
+for ((i = 0; i < SYMBOLS; i++)); do
+	args+=(-r "vmlinux.ext_fun_$i,0")
+done
+
+relocs=`readelf -r $TMPDIR/bench.o | grep -c ext_fun_`
+echo "Synthetic module: $FUNCTIONS functions, $SYMBOLS symbols to relocate, $relocs klp relocations"
+
+for bin in "${BINARIES[@]}"; do
+	cp $TMPDIR/bench.o $TMPDIR/run.o
+	start=`date +%s%N`
+	$bin "${args[@]}" $TMPDIR/run.o || { echo "$bin failed"; exit 1; }
+	end=`date +%s%N`
+	moved=`readelf -rW $TMPDIR/run.o | grep -c "\.klp\.sym\.vmlinux\.ext_fun_"`
+	echo "$bin: $(( (end - start) / 1000000 )) ms ($moved relocations in .klp.rela sections)"
+done
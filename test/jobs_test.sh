@@ -0,0 +1,85 @@
+#!/bin/bash
+# Author: Marek Maślanka
+# Project: DEKU
+# URL: https://github.com/MarekMaslanka/deku
+#
+# Test the job slots used by generate_module.sh to process files in parallel
+# Usage: test/jobs_test.sh
+
+TIMEOUT=20
+TESTDIR=$JOBS_TEST_DIR
+
+# Job that records how many jobs and their extra processes run at once
+countingJob()
+{
+	local rc=$1
+	local extra=$2
+	local token=
+	local running=$TESTDIR/running
+	mkdir -p $running
+	touch $running/$BASHPID
+	if [[ $extra == 1 ]] && takeJobToken token; then
+		touch $running/$BASHPID.extra
+	fi
+	ls $running | wc -l >> $TESTDIR/counts
+	sleep 0.2
+	rm -f $running/$BASHPID $running/$BASHPID.extra
+	[[ "$token" ]] && releaseJobToken "$token"
+	[[ $rc != 0 ]] && exit $rc
+	return 0
+}
+
+# Run jobs given as "<EXIT_CODE>:<TAKE_EXTRA_TOKEN>" with $JOBS slots.
+# Prints the exit code of waitForJobs and the maximum number of processes.
+runJobs()
+{
+	cd "$(dirname $0)/.."
+	. ./generate_module.sh
+	unset MAKEFLAGS
+	JOBS=$1
+	shift
+	initJobs
+	for job in "$@"; do
+		startJob "$TESTDIR/log" countingJob ${job%:*} ${job#*:}
+	done
+	waitForJobs > /dev/null 2>&1
+	echo "$? `sort -n $TESTDIR/counts | tail -1`"
+}
+
+if [[ "$1" == "--run" ]]; then
+	shift
+	runJobs "$@"
+	exit
+fi
+
+TESTDIR=`mktemp -d`
+trap "rm -rf $TESTDIR" EXIT
+
+check()
+{
+	local name=$1
+	local expected=$2
+	shift 2
+	rm -rf $TESTDIR/counts $TESTDIR/running
+	local result
+	result=`JOBS_TEST_DIR=$TESTDIR timeout $TIMEOUT "$0" --run "$@"`
+	if [[ $? == 124 ]]; then
+		echo "FAIL: $name (hung)"
+		return 1
+	fi
+	local rc=${result% *}
+	local max=${result#* }
+	if [[ $rc != ${expected% *} || $max -gt ${expected#* } ]]; then
+		echo "FAIL: $name (exit code $rc, $max processes at once, expected $expected)"
+		return 1
+	fi
+	echo "PASS: $name"
+}
+
+failed=0
+check "one slot, several files" "0 1" 1 0:0 0:0 0:0 0:0 || failed=1
+check "one slot, extra process" "0 1" 1 0:1 0:1 0:1 || failed=1
+check "failed job frees its slot" "5 2" 2 5:0 0:0 0:0 0:0 || failed=1
+check "all jobs fail" "3 2" 2 3:0 4:0 4:0 || failed=1
+check "extra processes" "0 3" 3 0:1 0:1 0:1 0:1 0:1 || failed=1
+exit $failed